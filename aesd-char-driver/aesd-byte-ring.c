@@ -0,0 +1,124 @@
+/**
+ * @file aesd-byte-ring.c
+ * @brief Contiguous byte ring storage for record payloads
+ *
+ * Any necessary locking must be performed by the caller.
+ *
+ * @date 2026-10-19
+ */
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+#include "aesd-byte-ring.h"
+
+/**
+ * Initializes @param ring to an empty ring stored in the @param capacity bytes at @param data
+ */
+void aesd_byte_ring_init(struct aesd_byte_ring *ring, char *data, size_t capacity)
+{
+    ring->data = data;
+    ring->capacity = data ? capacity : 0;
+    ring->start = 0;
+    ring->used = 0;
+}
+
+/**
+ * @return the number of bytes which can be appended to @param ring
+ */
+size_t aesd_byte_ring_space(const struct aesd_byte_ring *ring)
+{
+    return ring->capacity - ring->used;
+}
+
+/**
+ * Appends the @param len bytes at @param src after the newest byte of @param ring,
+ * wrapping around the end of the ring when needed.
+ * @param offset_rtn set to the offset in ring->data of the first byte appended
+ * @return true on success, false if fewer than @param len bytes are free
+ */
+bool aesd_byte_ring_append(struct aesd_byte_ring *ring, const char *src, size_t len, size_t *offset_rtn)
+{
+    size_t offset;
+    size_t first;
+
+    if (len > aesd_byte_ring_space(ring))
+    {
+        return false;
+    }
+    offset = aesd_byte_ring_offset(ring, ring->used);
+    first = ring->capacity - offset;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, src + first, len - first);
+    ring->used += len;
+    if (offset_rtn)
+    {
+        *offset_rtn = offset;
+    }
+    return true;
+}
+
+/**
+ * Releases the @param len oldest bytes of @param ring, or all of them if fewer are stored
+ */
+void aesd_byte_ring_consume(struct aesd_byte_ring *ring, size_t len)
+{
+    if (len >= ring->used)
+    {
+        // an empty ring restarts at the beginning so later records wrap less often
+        ring->start = 0;
+        ring->used = 0;
+        return;
+    }
+    ring->start = aesd_byte_ring_offset(ring, len);
+    ring->used -= len;
+}
+
+/**
+ * @return the offset in ring->data of the byte @param pos bytes after the oldest byte of @param ring
+ */
+size_t aesd_byte_ring_offset(const struct aesd_byte_ring *ring, size_t pos)
+{
+    size_t offset = ring->start + pos;
+
+    if (offset >= ring->capacity)
+    {
+        offset -= ring->capacity;
+    }
+    return offset;
+}
+
+/**
+ * Describes the @param len bytes starting at @param offset in ring->data of @param ring,
+ * as returned by aesd_byte_ring_append() or aesd_byte_ring_offset().
+ * @param spans filled with the contiguous parts in order
+ * @return the number of spans used, 0 for an empty range, otherwise 1 or 2
+ */
+unsigned int aesd_byte_ring_spans(const struct aesd_byte_ring *ring, size_t offset, size_t len,
+            struct aesd_byte_ring_span spans[2])
+{
+    size_t first;
+
+    if (len == 0 || offset >= ring->capacity)
+    {
+        return 0;
+    }
+    first = ring->capacity - offset;
+    spans[0].ptr = ring->data + offset;
+    if (len <= first)
+    {
+        spans[0].len = len;
+        return 1;
+    }
+    spans[0].len = first;
+    spans[1].ptr = ring->data;
+    spans[1].len = len - first;
+    return 2;
+}
@@ -0,0 +1,64 @@
+/*
+ * aesd-byte-ring.h
+ *
+ *  @brief Contiguous byte ring holding the payloads of consecutive records
+ *
+ *  Records are appended back to back and removed oldest first, so any range of consecutive
+ *  records occupies at most two contiguous spans of the ring.  A record stored here is
+ *  described by the offset of its first byte and its length, it may wrap around the end of
+ *  the ring, so it must be accessed through aesd_byte_ring_spans() and not as a plain pointer.
+ */
+
+#ifndef AESD_BYTE_RING_H
+#define AESD_BYTE_RING_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h> // size_t
+#include <stdbool.h>
+#endif
+
+struct aesd_byte_ring
+{
+    /**
+     * Storage of capacity bytes, allocated by and with a lifetime managed by the caller
+     */
+    char *data;
+    /**
+     * Number of bytes in data
+     */
+    size_t capacity;
+    /**
+     * The offset in data of the oldest byte stored
+     */
+    size_t start;
+    /**
+     * Number of bytes stored, starting at start and wrapping at capacity
+     */
+    size_t used;
+};
+
+/**
+ * A contiguous part of the ring
+ */
+struct aesd_byte_ring_span
+{
+    const char *ptr;
+    size_t len;
+};
+
+extern void aesd_byte_ring_init(struct aesd_byte_ring *ring, char *data, size_t capacity);
+
+extern size_t aesd_byte_ring_space(const struct aesd_byte_ring *ring);
+
+extern bool aesd_byte_ring_append(struct aesd_byte_ring *ring, const char *src, size_t len, size_t *offset_rtn);
+
+extern void aesd_byte_ring_consume(struct aesd_byte_ring *ring, size_t len);
+
+extern size_t aesd_byte_ring_offset(const struct aesd_byte_ring *ring, size_t pos);
+
+extern unsigned int aesd_byte_ring_spans(const struct aesd_byte_ring *ring, size_t offset, size_t len,
+            struct aesd_byte_ring_span spans[2]);
+
+#endif /* AESD_BYTE_RING_H */
@@ -0,0 +1,301 @@
+/**
+ * @file aesd-circular-buffer-bench.c
+ * @brief Microbenchmarks of the aesd-circular-buffer.c functions
+ *
+ * Usage: aesd-circular-buffer-bench [iterations]
+ * Measures aesd_circular_buffer_add_entry(), aesd_circular_buffer_find_entry_offset_for_fpos(),
+ * aesd_get_total_size() and aesd_get_offset() on a full buffer for several record size
+ * distributions and prints, per operation, the time, the instructions and the cache misses
+ * (counters are read with perf_event_open() and shown as "-" when not available, e.g. with
+ * kernel.perf_event_paranoid > 2 or in a VM without a PMU).
+ *
+ * The ring size is fixed at compile time by AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, the build
+ * produces one executable per ring size, see CMakeLists.txt.
+ *
+ * @date 2026-10-19
+ */
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "aesd-circular-buffer.h"
+
+#define BENCH_DEFAULT_ITERATIONS 1000000
+#define BENCH_MAX_RECORD_SIZE 4096
+#define BENCH_SIZE_TABLE 4096 // pregenerated record sizes, a power of two
+#define BENCH_QUERY_TABLE 4096 // pregenerated query positions, a power of two
+
+enum bench_counter
+{
+    BENCH_INSTRUCTIONS,
+    BENCH_CACHE_MISSES,
+    BENCH_L1D_MISSES,
+    BENCH_COUNTERS,
+};
+
+static const char *bench_counter_names[BENCH_COUNTERS] = { "instr/op", "cache-miss/op", "L1d-miss/op" };
+
+struct bench_distribution
+{
+    const char *name;
+    size_t (*next_size)(uint64_t *state);
+};
+
+struct bench_result
+{
+    double ns_per_op;
+    double counters[BENCH_COUNTERS]; // per operation, negative when not available
+};
+
+static int bench_counter_fds[BENCH_COUNTERS] = { -1, -1, -1 };
+static char bench_payload[BENCH_MAX_RECORD_SIZE];
+static volatile size_t bench_sink; // keeps the compiler from dropping results
+
+static uint64_t bench_random(uint64_t *state)
+{
+    // xorshift64, deterministic so every run uses the same sizes
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static size_t size_small(uint64_t *state)
+{
+    (void)state;
+    return 8; // a short token and newline
+}
+
+static size_t size_large(uint64_t *state)
+{
+    (void)state;
+    return BENCH_MAX_RECORD_SIZE;
+}
+
+static size_t size_uniform(uint64_t *state)
+{
+    return 1 + bench_random(state) % 256;
+}
+
+static size_t size_bimodal(uint64_t *state)
+{
+    // mostly short packets with the occasional large one
+    return (bench_random(state) % 10) ? 16 : 2048;
+}
+
+static const struct bench_distribution bench_distributions[] = {
+    { "fixed 8", size_small },
+    { "fixed 4096", size_large },
+    { "uniform 1-256", size_uniform },
+    { "bimodal 16/2048", size_bimodal },
+};
+
+static void bench_counters_open(void)
+{
+    static const struct { uint32_t type; uint64_t config; } events[BENCH_COUNTERS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < BENCH_COUNTERS; i++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        bench_counter_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void bench_counters_start(void)
+{
+    int i;
+
+    for (i = 0; i < BENCH_COUNTERS; i++)
+    {
+        if (bench_counter_fds[i] >= 0)
+        {
+            ioctl(bench_counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(bench_counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void bench_counters_stop(struct bench_result *result, size_t ops)
+{
+    uint64_t value;
+    int i;
+
+    for (i = 0; i < BENCH_COUNTERS; i++)
+    {
+        result->counters[i] = -1;
+        if (bench_counter_fds[i] >= 0)
+        {
+            ioctl(bench_counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(bench_counter_fds[i], &value, sizeof(value)) == sizeof(value))
+            {
+                result->counters[i] = (double)value / ops;
+            }
+        }
+    }
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Fills @param buffer with AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED records taken from @param sizes
+ */
+static void bench_fill(struct aesd_circular_buffer *buffer, const size_t *sizes)
+{
+    struct aesd_buffer_entry entry;
+    size_t i;
+
+    aesd_circular_buffer_init(buffer);
+    entry.buffptr = bench_payload;
+    for (i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; i++)
+    {
+        entry.size = sizes[i % BENCH_SIZE_TABLE];
+        aesd_circular_buffer_add_entry(buffer, &entry);
+    }
+}
+
+static void bench_print(const char *distribution, const char *operation, const struct bench_result *result)
+{
+    int i;
+
+    printf("%4d %-16s %-26s %9.2f", AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, distribution, operation,
+            result->ns_per_op);
+    for (i = 0; i < BENCH_COUNTERS; i++)
+    {
+        if (result->counters[i] < 0)
+        {
+            printf(" %13s", "-");
+        }
+        else
+        {
+            printf(" %13.2f", result->counters[i]);
+        }
+    }
+    printf("\n");
+}
+
+static void bench_distribution(const struct bench_distribution *distribution, size_t iterations)
+{
+    static size_t sizes[BENCH_SIZE_TABLE];
+    static size_t positions[BENCH_QUERY_TABLE];
+    static uint32_t cmds[BENCH_QUERY_TABLE];
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry entry;
+    struct bench_result result;
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    uint64_t start;
+    size_t total;
+    size_t offset;
+    size_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < BENCH_SIZE_TABLE; i++)
+    {
+        sizes[i] = distribution->next_size(&state);
+    }
+    bench_fill(&buffer, sizes);
+    total = aesd_get_total_size(&buffer);
+    for (i = 0; i < BENCH_QUERY_TABLE; i++)
+    {
+        positions[i] = bench_random(&state) % total;
+        cmds[i] = bench_random(&state) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+
+    // a full buffer, so every add overwrites the oldest entry as in steady state
+    entry.buffptr = bench_payload;
+    bench_counters_start();
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        entry.size = sizes[i & (BENCH_SIZE_TABLE - 1)];
+        aesd_circular_buffer_add_entry(&buffer, &entry);
+    }
+    result.ns_per_op = (double)(bench_now_ns() - start) / iterations;
+    bench_counters_stop(&result, iterations);
+    bench_print(distribution->name, "add_entry", &result);
+
+    // refill so the positions generated above fall inside the stored data again
+    bench_fill(&buffer, sizes);
+    bench_counters_start();
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        struct aesd_buffer_entry *found = aesd_circular_buffer_find_entry_offset_for_fpos(&buffer,
+                positions[i & (BENCH_QUERY_TABLE - 1)], &offset);
+        sum += (size_t)found + offset;
+    }
+    result.ns_per_op = (double)(bench_now_ns() - start) / iterations;
+    bench_counters_stop(&result, iterations);
+    bench_print(distribution->name, "find_entry_offset_for_fpos", &result);
+
+    bench_counters_start();
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        sum += aesd_get_total_size(&buffer);
+    }
+    result.ns_per_op = (double)(bench_now_ns() - start) / iterations;
+    bench_counters_stop(&result, iterations);
+    bench_print(distribution->name, "get_total_size", &result);
+
+    bench_counters_start();
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        sum += aesd_get_offset(&buffer, cmds[i & (BENCH_QUERY_TABLE - 1)], 0);
+    }
+    result.ns_per_op = (double)(bench_now_ns() - start) / iterations;
+    bench_counters_stop(&result, iterations);
+    bench_print(distribution->name, "get_offset", &result);
+
+    bench_sink = sum;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ITERATIONS;
+    size_t i;
+    int c;
+
+    if (iterations == 0)
+    {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    bench_counters_open();
+    printf("%4s %-16s %-26s %9s", "ring", "sizes", "operation", "ns/op");
+    for (c = 0; c < BENCH_COUNTERS; c++)
+    {
+        printf(" %13s", bench_counter_names[c]);
+    }
+    printf("\n");
+    for (i = 0; i < sizeof(bench_distributions) / sizeof(bench_distributions[0]); i++)
+    {
+        bench_distribution(&bench_distributions[i], iterations);
+    }
+    return 0;
+}
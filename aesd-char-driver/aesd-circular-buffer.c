@@ -25,6 +25,8 @@
  *      in aesd_buffer.
  * @return the struct aesd_buffer_entry structure representing the position described by char_offset, or
  * NULL if this position is not available in the buffer (not enough data is written).
+ * Only the sizes of the entries are used, the buffptr of the entry returned may be NULL when its
+ * record is not stored linearly, see aesd_circular_buffer_export_iovec().
  */
 struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn )
@@ -51,9 +53,6 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
         i = (i + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; //buffer wrap
     }
     return NULL;
-
-    // If the char_offset is not found in the buffer, return NULL
-    return NULL;
 }
 
 /**
@@ -71,7 +70,7 @@ void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const s
    if(!buffer | !add_entry) //invalid input
         return;
     
-    buffer->entry[buffer->in_offs] = *(add_entry);
+    buffer->entry[buffer->in_offs] = *add_entry;
     buffer->in_offs = (buffer->in_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
     if (buffer->full)
     {
@@ -83,6 +82,72 @@ void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const s
     }
 }
 
+/**
+* Removes the oldest entry from @param buffer and advances buffer->out_offs past it.
+* The entry is copied to @param removed_entry when not NULL and its slot is cleared.
+* Any necessary locking must be handled by the caller
+* Memory referenced by the removed entry is not freed, its lifetime is managed by the caller.
+* @return true if an entry was removed, false if the buffer was empty
+*/
+bool aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer, struct aesd_buffer_entry *removed_entry)
+{
+    if (!buffer || (!buffer->full && buffer->in_offs == buffer->out_offs))
+    {
+        return false;
+    }
+    if (removed_entry)
+    {
+        *removed_entry = buffer->entry[buffer->out_offs];
+    }
+    memset(&buffer->entry[buffer->out_offs], 0, sizeof(struct aesd_buffer_entry));
+    buffer->out_offs = (buffer->out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    buffer->full = false;
+    return true;
+}
+
+/**
+* Adds a record of @param size bytes at @param data to @param buffer like
+* aesd_circular_buffer_add_entry(), copying it into the inline_data slot of the new entry.
+* The inline_data slot of the entry being overwritten when the buffer is full is reused, so the
+* caller must be done with the oldest entry first, usually by removing it.
+* Any necessary locking must be handled by the caller
+* @return true if the record was added, false if it is larger than AESD_INLINE_RECORD_SIZE,
+* in which case @param buffer is unchanged and the caller must allocate the payload.
+*/
+bool aesd_circular_buffer_add_inline(struct aesd_circular_buffer *buffer, const char *data, size_t size)
+{
+#if AESD_INLINE_RECORD_SIZE > 0
+    struct aesd_buffer_entry entry;
+
+    if (buffer && size <= AESD_INLINE_RECORD_SIZE)
+    {
+        memcpy(buffer->inline_data[buffer->in_offs], data, size);
+        entry.buffptr = buffer->inline_data[buffer->in_offs];
+        entry.size = size;
+        aesd_circular_buffer_add_entry(buffer, &entry);
+        return true;
+    }
+#endif
+    return false;
+}
+
+/**
+* @return true if the contents of @param entry, an entry of @param buffer or one removed from it,
+* are stored in @param buffer, so there is nothing to free.  buffptr is only compared, never read,
+* so this also works for an entry removed from @param buffer whose slot was since reused.
+*/
+bool aesd_circular_buffer_entry_is_inline(const struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *entry)
+{
+#if AESD_INLINE_RECORD_SIZE > 0
+    const char *start = buffer->inline_data[0];
+
+    return entry->buffptr >= start && entry->buffptr < start + sizeof(buffer->inline_data);
+#else
+    return false;
+#endif
+}
+
 /**
 * Initializes the circular buffer described by @param buffer to an empty struct
 */
@@ -91,25 +156,33 @@ void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
     memset(buffer,0,sizeof(struct aesd_circular_buffer));
 }
 
-size_t aesd_get_total_size(struct aesd_circular_buffer *buffer)
+/**
+* @return the number of entries currently stored in @param buffer
+*/
+uint8_t aesd_circular_buffer_entry_count(struct aesd_circular_buffer *buffer)
 {
-    size_t total_size = 0;
-    uint8_t max = 0;
-    uint8_t idx;
-    uint8_t pos;
+    unsigned int count;
 
     if (buffer->full)
     {
-        max = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        return AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
     }
-    else
+    count = buffer->in_offs + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs;
+    if (count >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
     {
-        max = buffer->in_offs + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs;
-        if (max >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
-        {
-            max -= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-        }
+        count -= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
     }
+    return count;
+}
+
+size_t aesd_get_total_size(struct aesd_circular_buffer *buffer)
+{
+    size_t total_size = 0;
+    uint8_t max;
+    uint8_t idx;
+    uint8_t pos;
+
+    max = aesd_circular_buffer_entry_count(buffer);
 
     pos = buffer->out_offs;
     for (idx = 0; idx < max; ++idx)
@@ -128,22 +201,11 @@ size_t aesd_get_total_size(struct aesd_circular_buffer *buffer)
 long aesd_get_offset(struct aesd_circular_buffer *buffer, uint32_t write_cmd, uint32_t write_cmd_offset)
 {
     size_t total_size = 0;
-    uint8_t max = 0;
+    uint8_t max;
     uint8_t idx;
     uint8_t pos;
 
-    if (buffer->full)
-    {
-        max = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-    }
-    else
-    {
-        max = buffer->in_offs + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs;
-        if (max >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
-        {
-            max -= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-        }
-    }
+    max = aesd_circular_buffer_entry_count(buffer);
 
     if (write_cmd >= max)
     {
@@ -171,4 +233,72 @@ long aesd_get_offset(struct aesd_circular_buffer *buffer, uint32_t write_cmd, ui
     }
 
     return total_size;
-}
\ No newline at end of file
+}
+/**
+* Describes the contents of @param buffer in logical order, starting at @param char_offset as
+* in aesd_circular_buffer_find_entry_offset_for_fpos(), with one element of @param iov per entry.
+* The first element starts part way into its entry when @param char_offset is not at the start of
+* an entry, wrap around of the entry array is handled, empty slots are never visited.
+* Any necessary locking must be performed by caller, the elements stay valid until the entries
+* they point into are removed or overwritten.  An entry without a buffptr, such as a record kept
+* in a byte ring which may wrap, has no linear address and ends the description.
+* @param max_bytes the most bytes to describe, the last element is shortened to fit
+* @param iov_max the number of elements available in @param iov
+* @param bytes_rtn set to the number of bytes described when not NULL
+* @return the number of elements of @param iov filled, 0 when @param char_offset is past the end
+*/
+size_t aesd_circular_buffer_export_iovec(struct aesd_circular_buffer *buffer, size_t char_offset,
+            size_t max_bytes, aesd_iovec_t *iov, size_t iov_max, size_t *bytes_rtn)
+{
+    struct aesd_buffer_entry *entry;
+    size_t entry_offset = 0;
+    size_t bytes = 0;
+    size_t used = 0;
+    size_t len;
+    uint8_t remaining;
+    uint8_t pos;
+
+    if (bytes_rtn)
+    {
+        *bytes_rtn = 0;
+    }
+    if (!buffer || !iov)
+    {
+        return 0;
+    }
+    entry = aesd_circular_buffer_find_entry_offset_for_fpos(buffer, char_offset, &entry_offset);
+    if (!entry)
+    {
+        return 0;
+    }
+
+    // entries from the one found up to the newest
+    pos = entry - buffer->entry;
+    remaining = aesd_circular_buffer_entry_count(buffer) -
+            (pos + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    while (remaining && used < iov_max && bytes < max_bytes)
+    {
+        entry = &buffer->entry[pos];
+        if (!entry->buffptr)
+        {
+            break;
+        }
+        len = entry->size - entry_offset;
+        if (len > max_bytes - bytes)
+        {
+            len = max_bytes - bytes;
+        }
+        iov[used].iov_base = (void *)(entry->buffptr + entry_offset);
+        iov[used].iov_len = len;
+        used++;
+        bytes += len;
+        entry_offset = 0;
+        remaining--;
+        pos = (pos + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+    if (bytes_rtn)
+    {
+        *bytes_rtn = bytes;
+    }
+    return used;
+}
@@ -10,13 +10,34 @@
 
 #ifdef __KERNEL__
 #include <linux/types.h>
+#include <linux/uio.h>
+/**
+ * Element filled by aesd_circular_buffer_export_iovec(), a kernel address and a length
+ */
+typedef struct kvec aesd_iovec_t;
 #else
 #include <stddef.h> // size_t
 #include <stdint.h> // uintx_t
 #include <stdbool.h>
+#include <sys/uio.h> // struct iovec
+typedef struct iovec aesd_iovec_t;
 #endif
 
+/**
+ * Number of entries in the circular buffer, at most 255 since offsets are stored in a uint8_t.
+ * Overridden by the benchmarks, note it also sets the size of struct aesd_info in aesd_ioctl.h
+ */
+#ifndef AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
+#endif
+
+/**
+ * Records of up to this many bytes may be stored in the buffer itself instead of in a separate
+ * allocation, see aesd_circular_buffer_add_inline().  0 disables inline storage.
+ */
+#ifndef AESD_INLINE_RECORD_SIZE
+#define AESD_INLINE_RECORD_SIZE 32
+#endif
 
 struct aesd_buffer_entry
 {
@@ -49,6 +70,12 @@ struct aesd_circular_buffer
      * set to true when the buffer entry structure is full
      */
     bool full;
+#if AESD_INLINE_RECORD_SIZE > 0
+    /**
+     * Contents of small records, inline_data[i] is used by entry[i] when its buffptr points there
+     */
+    char inline_data[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED][AESD_INLINE_RECORD_SIZE];
+#endif
 };
 
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
@@ -56,15 +83,28 @@ extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos
 
 extern void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
 
+extern bool aesd_circular_buffer_remove_entry(struct aesd_circular_buffer *buffer, struct aesd_buffer_entry *removed_entry);
+
+extern bool aesd_circular_buffer_add_inline(struct aesd_circular_buffer *buffer, const char *data, size_t size);
+
+extern bool aesd_circular_buffer_entry_is_inline(const struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *entry);
+
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+extern uint8_t aesd_circular_buffer_entry_count(struct aesd_circular_buffer *buffer);
+
 extern size_t aesd_get_total_size(struct aesd_circular_buffer *buffer);
 
 extern long aesd_get_offset(struct aesd_circular_buffer *buffer, uint32_t write_cmd, uint32_t write_cmd_offset);
 
+extern size_t aesd_circular_buffer_export_iovec(struct aesd_circular_buffer *buffer, size_t char_offset,
+            size_t max_bytes, aesd_iovec_t *iov, size_t iov_max, size_t *bytes_rtn);
+
 /**
  * Create a for loop to iterate over each member of the circular buffer.
- * Useful when you've allocated memory for circular buffer entries and need to free it
+ * Useful when you've allocated memory for circular buffer entries and need to free it,
+ * entries for which aesd_circular_buffer_entry_is_inline() is true have no memory to free
  * @param entryptr is a struct aesd_buffer_entry* to set with the current entry
  * @param buffer is the struct aesd_buffer * describing the buffer
  * @param index is a uint8_t stack allocated value used by this macro for an index
@@ -73,7 +113,8 @@ extern long aesd_get_offset(struct aesd_circular_buffer *buffer, uint32_t write_
  * struct aesd_circular_buffer buffer;
  * struct aesd_buffer_entry *entry;
  * AESD_CIRCULAR_BUFFER_FOREACH(entry,&buffer,index) {
- *      free(entry->buffptr);
+ *      if (!aesd_circular_buffer_entry_is_inline(&buffer,entry))
+ *          free(entry->buffptr);
  * }
  */
 #define AESD_CIRCULAR_BUFFER_FOREACH(entryptr,buffer,index) \
@@ -0,0 +1,242 @@
+/**
+ * @file aesd-lockfree-buffer-bench.c
+ * @brief Throughput of aesd_lockfree_buffer compared with a mutex protected aesd_circular_buffer
+ *
+ * Usage: aesd-lockfree-buffer-bench [entries_per_producer] [producers]
+ * Each configuration moves the same number of entries from the producer threads to one
+ * consumer thread and prints the entries per second it achieved.  The mutex baseline holds
+ * AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED entries, the lock free buffer BENCH_CAPACITY.
+ * A thread which finds the buffer full (or empty) yields, so runs on few CPUs stay meaningful.
+ *
+ * @date 2026-10-19
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "aesd-circular-buffer.h"
+#include "aesd-lockfree-buffer.h"
+
+#define BENCH_CAPACITY 1024
+#define BENCH_BATCH_SIZE 32
+#define BENCH_DEFAULT_ENTRIES 2000000
+#define BENCH_DEFAULT_PRODUCERS 4
+
+enum bench_queue
+{
+    BENCH_LOCKFREE,
+    BENCH_MUTEX, // aesd_circular_buffer behind a pthread mutex, the way a caller must use it today
+};
+
+struct bench_config
+{
+    const char *name;
+    enum bench_queue queue;
+    enum aesd_lockfree_mode mode;
+    size_t producers;
+    size_t batch; // entries per enqueue and dequeue call
+};
+
+struct bench_run
+{
+    const struct bench_config *config;
+    size_t entries_per_producer;
+    struct aesd_lockfree_buffer lockfree;
+    pthread_mutex_t lock;
+    struct aesd_circular_buffer circular;
+};
+
+/**
+ * Adds up to @param count entries to the mutex protected circular buffer without
+ * overwriting, to match the lock free buffer which rejects entries when full
+ */
+static size_t bench_mutex_enqueue(struct bench_run *run, const struct aesd_buffer_entry *entries,
+        size_t count)
+{
+    size_t n = 0;
+
+    pthread_mutex_lock(&run->lock);
+    while (n < count && !run->circular.full)
+    {
+        aesd_circular_buffer_add_entry(&run->circular, &entries[n]);
+        n++;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return n;
+}
+
+static size_t bench_mutex_dequeue(struct bench_run *run, struct aesd_buffer_entry *entries,
+        size_t count)
+{
+    size_t n = 0;
+
+    pthread_mutex_lock(&run->lock);
+    while (n < count && aesd_circular_buffer_remove_entry(&run->circular, &entries[n]))
+    {
+        n++;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return n;
+}
+
+static size_t bench_enqueue(struct bench_run *run, const struct aesd_buffer_entry *entries,
+        size_t count)
+{
+    if (run->config->queue == BENCH_MUTEX)
+    {
+        return bench_mutex_enqueue(run, entries, count);
+    }
+    return aesd_lockfree_buffer_enqueue_batch(&run->lockfree, entries, count);
+}
+
+static size_t bench_dequeue(struct bench_run *run, struct aesd_buffer_entry *entries, size_t count)
+{
+    if (run->config->queue == BENCH_MUTEX)
+    {
+        return bench_mutex_dequeue(run, entries, count);
+    }
+    return aesd_lockfree_buffer_dequeue_batch(&run->lockfree, entries, count);
+}
+
+static void *bench_producer(void *arg)
+{
+    struct bench_run *run = arg;
+    struct aesd_buffer_entry entries[BENCH_BATCH_SIZE];
+    size_t batch = run->config->batch;
+    size_t sent = 0;
+    size_t i;
+
+    for (i = 0; i < batch; i++)
+    {
+        entries[i].buffptr = "bench\n";
+        entries[i].size = 6;
+    }
+    while (sent < run->entries_per_producer)
+    {
+        size_t count = run->entries_per_producer - sent;
+
+        if (count > batch)
+        {
+            count = batch;
+        }
+        count = bench_enqueue(run, entries, count);
+        if (count == 0)
+        {
+            sched_yield();
+        }
+        sent += count;
+    }
+    return NULL;
+}
+
+static double bench_elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * Runs @param config and prints its throughput.
+ * @return 0 on success, -1 if the run could not be set up
+ */
+static int bench_run(const struct bench_config *config, size_t entries_per_producer)
+{
+    struct bench_run run;
+    struct aesd_buffer_entry entries[BENCH_BATCH_SIZE];
+    pthread_t threads[64];
+    struct timespec start;
+    struct timespec end;
+    size_t total = entries_per_producer * config->producers;
+    size_t received = 0;
+    size_t count;
+    size_t started;
+    double seconds;
+
+    run.config = config;
+    run.entries_per_producer = entries_per_producer;
+    if (config->queue == BENCH_LOCKFREE)
+    {
+        if (aesd_lockfree_buffer_init(&run.lockfree, BENCH_CAPACITY, config->mode) != 0)
+        {
+            perror("aesd_lockfree_buffer_init");
+            return -1;
+        }
+    }
+    else
+    {
+        pthread_mutex_init(&run.lock, NULL);
+        aesd_circular_buffer_init(&run.circular);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (started = 0; started < config->producers; started++)
+    {
+        if (pthread_create(&threads[started], NULL, bench_producer, &run) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    while (received < total)
+    {
+        count = bench_dequeue(&run, entries, config->batch);
+        if (count == 0)
+        {
+            sched_yield();
+        }
+        received += count;
+    }
+    for (started = 0; started < config->producers; started++)
+    {
+        pthread_join(threads[started], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    seconds = bench_elapsed(&start, &end);
+    printf("%-28s producers %2zu batch %2zu  %8.3f s  %12.0f entries/s\n", config->name,
+            config->producers, config->batch, seconds, (double)total / seconds);
+
+    if (config->queue == BENCH_LOCKFREE)
+    {
+        aesd_lockfree_buffer_destroy(&run.lockfree);
+    }
+    else
+    {
+        pthread_mutex_destroy(&run.lock);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t entries = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ENTRIES;
+    size_t producers = argc > 2 ? strtoul(argv[2], NULL, 0) : BENCH_DEFAULT_PRODUCERS;
+    const struct bench_config configs[] = {
+        { "mutex circular buffer", BENCH_MUTEX, AESD_LOCKFREE_SPSC, 1, 1 },
+        { "mutex circular buffer", BENCH_MUTEX, AESD_LOCKFREE_SPSC, 1, BENCH_BATCH_SIZE },
+        { "lock free spsc", BENCH_LOCKFREE, AESD_LOCKFREE_SPSC, 1, 1 },
+        { "lock free spsc", BENCH_LOCKFREE, AESD_LOCKFREE_SPSC, 1, BENCH_BATCH_SIZE },
+        { "mutex circular buffer", BENCH_MUTEX, AESD_LOCKFREE_MPSC, producers, 1 },
+        { "mutex circular buffer", BENCH_MUTEX, AESD_LOCKFREE_MPSC, producers, BENCH_BATCH_SIZE },
+        { "lock free mpsc", BENCH_LOCKFREE, AESD_LOCKFREE_MPSC, producers, 1 },
+        { "lock free mpsc", BENCH_LOCKFREE, AESD_LOCKFREE_MPSC, producers, BENCH_BATCH_SIZE },
+    };
+    size_t i;
+
+    if (entries == 0 || producers == 0 || producers > 64)
+    {
+        fprintf(stderr, "Usage: %s [entries_per_producer] [producers, 1 to 64]\n", argv[0]);
+        return 1;
+    }
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        if (bench_run(&configs[i], entries) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file aesd-lockfree-buffer.c
+ * @brief Lock free single consumer queue of aesd_buffer_entry for user space
+ *
+ * SPSC mode is a plain ring where each side caches the index of the other side and only
+ * rereads it when the cached value says the ring is full (producer) or empty (consumer).
+ * MPSC mode is a bounded queue with a sequence number in each slot: producers claim positions
+ * with a compare and swap on head and publish each slot by advancing its sequence, the
+ * consumer frees a slot for the next lap by setting its sequence one capacity ahead.
+ *
+ * @date 2026-10-19
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aesd-lockfree-buffer.h"
+
+/**
+ * Initializes @param buffer to an empty queue of @param capacity entries.
+ * @param capacity must be a power of two and at least 2
+ * @param mode selects single or multiple producers
+ * @return 0 on success, -1 with errno set to EINVAL or ENOMEM on failure
+ */
+int aesd_lockfree_buffer_init(struct aesd_lockfree_buffer *buffer, size_t capacity,
+            enum aesd_lockfree_mode mode)
+{
+    size_t i;
+    size_t bytes;
+
+    if (!buffer || capacity < 2 || (capacity & (capacity - 1)) != 0 ||
+            capacity > SIZE_MAX / sizeof(struct aesd_lockfree_slot))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(buffer, 0, sizeof(*buffer));
+    // round up so aligned_alloc accepts the size, and no other data shares the last line
+    bytes = capacity * sizeof(struct aesd_lockfree_slot);
+    bytes = (bytes + AESD_LOCKFREE_CACHE_LINE_SIZE - 1) & ~(size_t)(AESD_LOCKFREE_CACHE_LINE_SIZE - 1);
+    buffer->slots = aligned_alloc(AESD_LOCKFREE_CACHE_LINE_SIZE, bytes);
+    if (!buffer->slots)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < capacity; i++)
+    {
+        atomic_init(&buffer->slots[i].sequence, i);
+        buffer->slots[i].entry.buffptr = NULL;
+        buffer->slots[i].entry.size = 0;
+    }
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+    buffer->mask = capacity - 1;
+    buffer->mode = mode;
+    return 0;
+}
+
+/**
+ * Frees the slots of @param buffer.  Memory referenced by entries still queued is not freed.
+ */
+void aesd_lockfree_buffer_destroy(struct aesd_lockfree_buffer *buffer)
+{
+    if (buffer)
+    {
+        free(buffer->slots);
+        buffer->slots = NULL;
+    }
+}
+
+static size_t aesd_lockfree_spsc_enqueue(struct aesd_lockfree_buffer *buffer,
+            const struct aesd_buffer_entry *entries, size_t count)
+{
+    size_t capacity = buffer->mask + 1;
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    size_t room = capacity - (head - buffer->tail_cache);
+    size_t i;
+
+    if (room < count)
+    {
+        buffer->tail_cache = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+        room = capacity - (head - buffer->tail_cache);
+    }
+    if (count > room)
+    {
+        count = room;
+    }
+    for (i = 0; i < count; i++)
+    {
+        buffer->slots[(head + i) & buffer->mask].entry = entries[i];
+    }
+    if (count)
+    {
+        atomic_store_explicit(&buffer->head, head + count, memory_order_release);
+    }
+    return count;
+}
+
+static size_t aesd_lockfree_spsc_dequeue(struct aesd_lockfree_buffer *buffer,
+            struct aesd_buffer_entry *entries, size_t count)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    size_t available = buffer->head_cache - tail;
+    size_t i;
+
+    if (available < count)
+    {
+        buffer->head_cache = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        available = buffer->head_cache - tail;
+    }
+    if (count > available)
+    {
+        count = available;
+    }
+    for (i = 0; i < count; i++)
+    {
+        entries[i] = buffer->slots[(tail + i) & buffer->mask].entry;
+    }
+    if (count)
+    {
+        atomic_store_explicit(&buffer->tail, tail + count, memory_order_release);
+    }
+    return count;
+}
+
+static size_t aesd_lockfree_mpsc_enqueue(struct aesd_lockfree_buffer *buffer,
+            const struct aesd_buffer_entry *entries, size_t count)
+{
+    size_t capacity = buffer->mask + 1;
+    size_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    size_t wanted = count < capacity ? count : capacity;
+    size_t last;
+    size_t sequence;
+    size_t i;
+
+    if (wanted == 0)
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        // slots are freed in order, so when the last slot of the range is free they all are
+        last = pos + wanted - 1;
+        sequence = atomic_load_explicit(&buffer->slots[last & buffer->mask].sequence,
+                memory_order_acquire);
+        if (sequence == last)
+        {
+            if (atomic_compare_exchange_weak_explicit(&buffer->head, &pos, pos + wanted,
+                        memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+            // pos now holds the current head, retry from there
+        }
+        else if ((ptrdiff_t)(sequence - last) < 0)
+        {
+            // not enough free slots for the whole range, shrink it to what the consumer released.
+            // head is read after tail so it can never be behind it.
+            size_t tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+            size_t used;
+
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+            used = pos - tail;
+            if (used >= capacity)
+            {
+                return 0;
+            }
+            if (wanted > capacity - used)
+            {
+                wanted = capacity - used;
+            }
+        }
+        else
+        {
+            // another producer claimed the range first
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+        }
+    }
+
+    for (i = 0; i < wanted; i++)
+    {
+        struct aesd_lockfree_slot *slot = &buffer->slots[(pos + i) & buffer->mask];
+
+        slot->entry = entries[i];
+        atomic_store_explicit(&slot->sequence, pos + i + 1, memory_order_release);
+    }
+    return wanted;
+}
+
+static size_t aesd_lockfree_mpsc_dequeue(struct aesd_lockfree_buffer *buffer,
+            struct aesd_buffer_entry *entries, size_t count)
+{
+    size_t capacity = buffer->mask + 1;
+    size_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    size_t n;
+
+    for (n = 0; n < count; n++)
+    {
+        struct aesd_lockfree_slot *slot = &buffer->slots[(pos + n) & buffer->mask];
+
+        // stop at the first slot whose producer has not published yet
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + n + 1)
+        {
+            break;
+        }
+        entries[n] = slot->entry;
+        atomic_store_explicit(&slot->sequence, pos + n + capacity, memory_order_release);
+    }
+    if (n)
+    {
+        atomic_store_explicit(&buffer->tail, pos + n, memory_order_release);
+    }
+    return n;
+}
+
+/**
+ * Adds @param entry to @param buffer.
+ * Any memory referenced in @param entry must have a lifetime managed by the caller.
+ * @return true if the entry was added, false if the buffer was full
+ */
+bool aesd_lockfree_buffer_enqueue(struct aesd_lockfree_buffer *buffer,
+            const struct aesd_buffer_entry *entry)
+{
+    return aesd_lockfree_buffer_enqueue_batch(buffer, entry, 1) == 1;
+}
+
+/**
+ * Removes the oldest entry from @param buffer into @param entry.
+ * Must only be called from the single consumer thread.
+ * @return true if an entry was removed, false if the buffer was empty
+ */
+bool aesd_lockfree_buffer_dequeue(struct aesd_lockfree_buffer *buffer,
+            struct aesd_buffer_entry *entry)
+{
+    return aesd_lockfree_buffer_dequeue_batch(buffer, entry, 1) == 1;
+}
+
+/**
+ * Adds up to @param count entries from @param entries to @param buffer as one contiguous run,
+ * publishing them with a single update of the head index in SPSC mode and a single claim
+ * in MPSC mode.
+ * @return the number of entries added, which is less than @param count when the buffer fills
+ */
+size_t aesd_lockfree_buffer_enqueue_batch(struct aesd_lockfree_buffer *buffer,
+            const struct aesd_buffer_entry *entries, size_t count)
+{
+    if (!buffer || !entries)
+    {
+        return 0;
+    }
+    if (buffer->mode == AESD_LOCKFREE_SPSC)
+    {
+        return aesd_lockfree_spsc_enqueue(buffer, entries, count);
+    }
+    return aesd_lockfree_mpsc_enqueue(buffer, entries, count);
+}
+
+/**
+ * Removes up to @param count of the oldest entries from @param buffer into @param entries,
+ * with a single update of the tail index.
+ * Must only be called from the single consumer thread.
+ * @return the number of entries removed
+ */
+size_t aesd_lockfree_buffer_dequeue_batch(struct aesd_lockfree_buffer *buffer,
+            struct aesd_buffer_entry *entries, size_t count)
+{
+    if (!buffer || !entries)
+    {
+        return 0;
+    }
+    if (buffer->mode == AESD_LOCKFREE_SPSC)
+    {
+        return aesd_lockfree_spsc_dequeue(buffer, entries, count);
+    }
+    return aesd_lockfree_mpsc_dequeue(buffer, entries, count);
+}
@@ -0,0 +1,89 @@
+/*
+ * aesd-lockfree-buffer.h
+ *
+ *  @brief Lock free queue of aesd_buffer_entry for user space, built on C11 atomics
+ *
+ *  Unlike aesd_circular_buffer this buffer needs no lock from the caller.  It supports a
+ *  single producer (AESD_LOCKFREE_SPSC) or any number of producers (AESD_LOCKFREE_MPSC),
+ *  in both cases with a single consumer.  A full buffer rejects new entries instead of
+ *  overwriting the oldest one, since only the consumer may release an entry's memory.
+ */
+
+#ifndef AESD_LOCKFREE_BUFFER_H
+#define AESD_LOCKFREE_BUFFER_H
+
+#ifdef __KERNEL__
+#error "aesd-lockfree-buffer is only available in user space"
+#endif
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "aesd-circular-buffer.h"
+
+/**
+ * Alignment used to keep the producer and consumer indexes on separate cache lines
+ */
+#define AESD_LOCKFREE_CACHE_LINE_SIZE 64
+
+enum aesd_lockfree_mode
+{
+    AESD_LOCKFREE_SPSC, // one producer thread and one consumer thread
+    AESD_LOCKFREE_MPSC, // any number of producer threads and one consumer thread
+};
+
+struct aesd_lockfree_slot
+{
+    /**
+     * In MPSC mode, equal to the enqueue position which may fill this slot when it is free
+     * and to that position + 1 once the entry is published.  Unused in SPSC mode.
+     */
+    atomic_size_t sequence;
+    struct aesd_buffer_entry entry;
+};
+
+struct aesd_lockfree_buffer
+{
+    /**
+     * The position of the next enqueue, written by producers
+     */
+    alignas(AESD_LOCKFREE_CACHE_LINE_SIZE) atomic_size_t head;
+    /**
+     * The last value of tail seen by the producer, SPSC mode only
+     */
+    size_t tail_cache;
+    /**
+     * The position of the next dequeue, written by the consumer
+     */
+    alignas(AESD_LOCKFREE_CACHE_LINE_SIZE) atomic_size_t tail;
+    /**
+     * The last value of head seen by the consumer, SPSC mode only
+     */
+    size_t head_cache;
+    /**
+     * Fields below are only written by aesd_lockfree_buffer_init()
+     */
+    alignas(AESD_LOCKFREE_CACHE_LINE_SIZE) struct aesd_lockfree_slot *slots;
+    size_t mask;
+    enum aesd_lockfree_mode mode;
+};
+
+extern int aesd_lockfree_buffer_init(struct aesd_lockfree_buffer *buffer, size_t capacity,
+            enum aesd_lockfree_mode mode);
+
+extern void aesd_lockfree_buffer_destroy(struct aesd_lockfree_buffer *buffer);
+
+extern bool aesd_lockfree_buffer_enqueue(struct aesd_lockfree_buffer *buffer,
+            const struct aesd_buffer_entry *entry);
+
+extern bool aesd_lockfree_buffer_dequeue(struct aesd_lockfree_buffer *buffer,
+            struct aesd_buffer_entry *entry);
+
+extern size_t aesd_lockfree_buffer_enqueue_batch(struct aesd_lockfree_buffer *buffer,
+            const struct aesd_buffer_entry *entries, size_t count);
+
+extern size_t aesd_lockfree_buffer_dequeue_batch(struct aesd_lockfree_buffer *buffer,
+            struct aesd_buffer_entry *entries, size_t count);
+
+#endif /* AESD_LOCKFREE_BUFFER_H */
@@ -17,6 +17,7 @@
 #include <sys/ioctl.h>
 #include <stdint.h>
 #endif
+#include "aesd-circular-buffer.h"
 
 /**
  * A structure to be passed by IOCTL from user space to kernel space, describing the type
@@ -33,14 +34,76 @@ struct aesd_seekto {
     uint32_t write_cmd_offset;
 };
 
+/**
+ * Filled in by AESDCHAR_IOCGINFO with a description of the records currently stored
+ */
+struct aesd_info {
+    /**
+     * The number of records stored, at most AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+     */
+    uint32_t entry_count;
+    /**
+     * The size of each record, oldest first.  Only the first entry_count values are set.
+     */
+    uint32_t entry_size[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    /**
+     * The sum of all record sizes, the length of the data returned by reading the device
+     */
+    uint64_t total_bytes;
+};
+
+/**
+ * Passed to AESDCHAR_IOCSNAPSHOT to copy whole records into a user buffer in one call,
+ * while no write can change the device contents
+ */
+struct aesd_snapshot {
+    /**
+     * The zero referenced record to start copying from, numbered like write_cmd of aesd_seekto
+     */
+    uint32_t first_cmd;
+    /**
+     * On input the maximum number of records to copy, or 0 to copy as many as fit in buf.
+     * On return the number of records copied.
+     */
+    uint32_t cmd_count;
+    /**
+     * The user space address of the destination buffer
+     */
+    uint64_t buf;
+    /**
+     * The size of the destination buffer
+     */
+    uint64_t buf_len;
+    /**
+     * On return the number of bytes copied into buf
+     */
+    uint64_t bytes_copied;
+};
+
 // Pick an arbitrary unused value from https://github.com/torvalds/linux/blob/master/Documentation/userspace-api/ioctl/ioctl-number.rst
 #define AESD_IOC_MAGIC 0x16
 
 // Define a write command from the user point of view, use command number 1
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+/**
+ * Enable (non zero) or disable (zero) follow mode for this open file.  In follow mode a read
+ * at the end of the data blocks until the next record is written, like tail -f, unless the file
+ * was opened with O_NONBLOCK in which case it fails with EAGAIN.  The file position is kept on
+ * the same byte of data when older records are evicted.
+ */
+#define AESDCHAR_IOCSFOLLOW _IOW(AESD_IOC_MAGIC, 2, uint32_t)
+/**
+ * Return the record count, each record size and the total size in one call
+ */
+#define AESDCHAR_IOCGINFO _IOR(AESD_IOC_MAGIC, 3, struct aesd_info)
+/**
+ * Copy a range of whole records into a user buffer.  Fails with EINVAL if first_cmd is past
+ * the last record and with ENOSPC if the first record does not fit in buf_len.
+ */
+#define AESDCHAR_IOCSNAPSHOT _IOWR(AESD_IOC_MAGIC, 4, struct aesd_snapshot)
 /**
  * The maximum number of commands supported, used for bounds checking
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 4
 
 #endif /* AESD_IOCTL_H */
@@ -0,0 +1,127 @@
+/*
+ * aesd_trace.h
+ *
+ *  @brief Tracepoints for the aesdchar driver, enable with
+ *  echo 1 > /sys/kernel/tracing/events/aesdchar/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aesdchar
+
+#if !defined(AESD_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AESD_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/**
+ * A read or write call, with the file position it started at, the number of bytes
+ * requested, the value returned and the time spent in the driver
+ */
+DECLARE_EVENT_CLASS(aesd_io,
+    TP_PROTO(unsigned int minor, loff_t pos, size_t count, ssize_t ret, u64 latency_ns),
+    TP_ARGS(minor, pos, count, ret, latency_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(loff_t, pos)
+        __field(size_t, count)
+        __field(ssize_t, ret)
+        __field(u64, latency_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->pos = pos;
+        __entry->count = count;
+        __entry->ret = ret;
+        __entry->latency_ns = latency_ns;
+    ),
+    TP_printk("minor=%u pos=%lld count=%zu ret=%zd latency_ns=%llu",
+        __entry->minor, __entry->pos, __entry->count, __entry->ret, __entry->latency_ns)
+);
+
+DEFINE_EVENT(aesd_io, aesd_read,
+    TP_PROTO(unsigned int minor, loff_t pos, size_t count, ssize_t ret, u64 latency_ns),
+    TP_ARGS(minor, pos, count, ret, latency_ns)
+);
+
+DEFINE_EVENT(aesd_io, aesd_write,
+    TP_PROTO(unsigned int minor, loff_t pos, size_t count, ssize_t ret, u64 latency_ns),
+    TP_ARGS(minor, pos, count, ret, latency_ns)
+);
+
+/**
+ * An AESDCHAR_IOCSEEKTO request and the file position it resolved to
+ */
+TRACE_EVENT(aesd_adjust_file_offset,
+    TP_PROTO(unsigned int minor, unsigned int write_cmd, unsigned int write_cmd_offset,
+        loff_t new_pos, long ret),
+    TP_ARGS(minor, write_cmd, write_cmd_offset, new_pos, ret),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, write_cmd)
+        __field(unsigned int, write_cmd_offset)
+        __field(loff_t, new_pos)
+        __field(long, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->write_cmd = write_cmd;
+        __entry->write_cmd_offset = write_cmd_offset;
+        __entry->new_pos = new_pos;
+        __entry->ret = ret;
+    ),
+    TP_printk("minor=%u write_cmd=%u write_cmd_offset=%u new_pos=%lld ret=%ld",
+        __entry->minor, __entry->write_cmd, __entry->write_cmd_offset,
+        __entry->new_pos, __entry->ret)
+);
+
+/**
+ * A record added to the circular buffer, with the number of records stored afterwards
+ * and the total size of the stored records
+ */
+TRACE_EVENT(aesd_record_complete,
+    TP_PROTO(unsigned int minor, size_t size, unsigned int entries, size_t total_size),
+    TP_ARGS(minor, size, entries, total_size),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(size_t, size)
+        __field(unsigned int, entries)
+        __field(size_t, total_size)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->size = size;
+        __entry->entries = entries;
+        __entry->total_size = total_size;
+    ),
+    TP_printk("minor=%u size=%zu entries=%u total_size=%zu",
+        __entry->minor, __entry->size, __entry->entries, __entry->total_size)
+);
+
+/**
+ * The oldest record dropped from the circular buffer, with the total bytes evicted so far
+ */
+TRACE_EVENT(aesd_evict,
+    TP_PROTO(unsigned int minor, size_t size, u64 bytes_evicted),
+    TP_ARGS(minor, size, bytes_evicted),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(size_t, size)
+        __field(u64, bytes_evicted)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->size = size;
+        __entry->bytes_evicted = bytes_evicted;
+    ),
+    TP_printk("minor=%u size=%zu bytes_evicted=%llu",
+        __entry->minor, __entry->size, __entry->bytes_evicted)
+);
+
+#endif /* AESD_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aesd_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,358 @@
+/**
+ * @file aesdchar-cuse.c
+ * @brief User space build of the aesdchar device served through CUSE
+ *
+ * Serves a character device with the same read, write and AESDCHAR_IOCSEEKTO behaviour as
+ * the aesdchar kernel module, built on the same aesd-circular-buffer.c, so the driver logic
+ * and everything above it (aesdsocket, the test scripts) can be run and profiled with
+ * ordinary user space tools and without loading a module.
+ *
+ * Usage: aesdchar-cuse [-f] [-s] [--name=aesdchar]
+ * creates /dev/<name>, the process needs access to /dev/cuse.
+ *
+ * The CUSE kernel side does not forward lseek() and passes every read and write at offset 0,
+ * so the file position of each open file is tracked here and only AESDCHAR_IOCSEEKTO
+ * (and reopening the device) can move it.
+ *
+ * @date 2026-10-19
+ */
+
+#define FUSE_USE_VERSION 31
+
+#include <cuse_lowlevel.h>
+#include <fuse_opt.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aesd-circular-buffer.h"
+#include "aesd_ioctl.h"
+
+/**
+ * State of the device, equivalent to the kernel struct aesd_dev
+ */
+struct aesd_cuse_dev
+{
+    pthread_mutex_t lock; // protects everything below, CUSE requests run on several threads
+    struct aesd_circular_buffer buffer; // completed records
+    char *write_buf; // staging buffer for the partial record
+    size_t write_buf_size; // bytes of the partial record held in write_buf
+    size_t write_buf_capacity; // bytes allocated for write_buf
+};
+
+/**
+ * State of an open file, stored in fi->fh
+ */
+struct aesd_cuse_file
+{
+    size_t pos; // file position, see the note at the top of the file
+};
+
+static struct aesd_cuse_dev aesd_cuse_device = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct aesd_cuse_file *aesd_cuse_file(struct fuse_file_info *fi)
+{
+    return (struct aesd_cuse_file *)(uintptr_t)fi->fh;
+}
+
+static void aesd_cuse_open(fuse_req_t req, struct fuse_file_info *fi)
+{
+    struct aesd_cuse_file *file = calloc(1, sizeof(*file));
+
+    if (!file)
+    {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    fi->fh = (uintptr_t)file;
+    fuse_reply_open(req, fi);
+}
+
+static void aesd_cuse_release(fuse_req_t req, struct fuse_file_info *fi)
+{
+    free(aesd_cuse_file(fi));
+    fuse_reply_err(req, 0);
+}
+
+/**
+ * Reply with up to @param size bytes starting at the file position, continuing across records
+ * like aesd_read() in main.c.  The reply is gathered straight from the records with
+ * aesd_circular_buffer_export_iovec(), without copying them into a staging buffer first.
+ */
+static void aesd_cuse_read(fuse_req_t req, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    struct aesd_cuse_file *file = aesd_cuse_file(fi);
+    struct iovec iov[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    size_t iov_count;
+    size_t bytes;
+
+    (void)off;
+    pthread_mutex_lock(&dev->lock);
+    iov_count = aesd_circular_buffer_export_iovec(&dev->buffer, file->pos, size,
+            iov, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &bytes);
+    // the records must stay in place until the reply is written to /dev/cuse
+    if (fuse_reply_iov(req, iov, iov_count) == 0)
+    {
+        file->pos += bytes;
+    }
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/**
+ * Add the @param size bytes at @param start in the staging buffer as a completed record,
+ * stored inline when small enough, freeing the oldest record if the buffer is full.  Caller must hold the device lock.
+ */
+static int aesd_cuse_complete_record(struct aesd_cuse_dev *dev, size_t start, size_t size)
+{
+    struct aesd_buffer_entry entry;
+    struct aesd_buffer_entry oldest;
+    char *payload = NULL;
+
+    if (size > AESD_INLINE_RECORD_SIZE)
+    {
+        payload = malloc(size);
+        if (!payload)
+        {
+            return -ENOMEM;
+        }
+        memcpy(payload, dev->write_buf + start, size);
+    }
+
+    // the oldest record goes first, an inline record reuses its slot
+    if (dev->buffer.full && aesd_circular_buffer_remove_entry(&dev->buffer, &oldest) &&
+            !aesd_circular_buffer_entry_is_inline(&dev->buffer, &oldest))
+    {
+        free((char *)oldest.buffptr);
+    }
+    if (!payload)
+    {
+        aesd_circular_buffer_add_inline(&dev->buffer, dev->write_buf + start, size);
+        return 0;
+    }
+    entry.buffptr = payload;
+    entry.size = size;
+    aesd_circular_buffer_add_entry(&dev->buffer, &entry);
+    return 0;
+}
+
+/**
+ * Append @param buf to the partial record, adding a record for each newline found,
+ * like aesd_write() in main.c
+ */
+static void aesd_cuse_write(fuse_req_t req, const char *buf, size_t size, off_t off,
+        struct fuse_file_info *fi)
+{
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    size_t staged_size;
+    size_t record_start = 0;
+    size_t scan;
+    char *newline;
+    int err = 0;
+
+    (void)off;
+    (void)fi;
+    pthread_mutex_lock(&dev->lock);
+
+    staged_size = dev->write_buf_size;
+    if (staged_size + size > dev->write_buf_capacity)
+    {
+        // grow geometrically like aesd_reserve_staging()
+        size_t capacity = dev->write_buf_capacity * 2;
+        char *staging;
+
+        if (capacity < staged_size + size)
+        {
+            capacity = staged_size + size;
+        }
+        staging = realloc(dev->write_buf, capacity);
+        if (!staging)
+        {
+            pthread_mutex_unlock(&dev->lock);
+            fuse_reply_err(req, ENOMEM);
+            return;
+        }
+        dev->write_buf = staging;
+        dev->write_buf_capacity = capacity;
+    }
+    memcpy(dev->write_buf + staged_size, buf, size);
+    dev->write_buf_size = staged_size + size;
+
+    // every newline terminates a record
+    scan = staged_size;
+    while ((newline = memchr(dev->write_buf + scan, '\n', dev->write_buf_size - scan)))
+    {
+        size_t record_end = (size_t)(newline - dev->write_buf) + 1;
+
+        err = aesd_cuse_complete_record(dev, record_start, record_end - record_start);
+        if (err)
+        {
+            break;
+        }
+        record_start = scan = record_end;
+    }
+
+    if (err && record_start == 0)
+    {
+        dev->write_buf_size = staged_size;
+        pthread_mutex_unlock(&dev->lock);
+        fuse_reply_err(req, -err);
+        return;
+    }
+    if (err)
+    {
+        dev->write_buf_size = 0;
+        pthread_mutex_unlock(&dev->lock);
+        fuse_reply_write(req, record_start - staged_size);
+        return;
+    }
+
+    // keep whatever follows the last newline as the new partial record
+    dev->write_buf_size -= record_start;
+    memmove(dev->write_buf, dev->write_buf + record_start, dev->write_buf_size);
+    pthread_mutex_unlock(&dev->lock);
+    fuse_reply_write(req, size);
+}
+
+/**
+ * Restricted ioctls only, the kernel copies the argument described by the command
+ * encoding into @param in_buf and back out of the reply.
+ * AESDCHAR_IOCSEEKTO and AESDCHAR_IOCGINFO are supported, the ioctls which need a blocking
+ * read or a user space pointer (AESDCHAR_IOCSFOLLOW, AESDCHAR_IOCSNAPSHOT) fail with ENOTTY.
+ */
+static void aesd_cuse_ioctl(fuse_req_t req, int cmd, void *arg, struct fuse_file_info *fi,
+        unsigned int flags, const void *in_buf, size_t in_bufsz, size_t out_bufsz)
+{
+    struct aesd_cuse_dev *dev = &aesd_cuse_device;
+    struct aesd_cuse_file *file = aesd_cuse_file(fi);
+    struct aesd_seekto seekto;
+    struct aesd_info info;
+    long new_pos;
+    uint8_t idx;
+    uint8_t pos;
+
+    (void)arg;
+    (void)out_bufsz;
+    if (flags & FUSE_IOCTL_COMPAT)
+    {
+        fuse_reply_err(req, ENOSYS);
+        return;
+    }
+
+    switch ((unsigned int)cmd)
+    {
+        case AESDCHAR_IOCSEEKTO:
+            if (in_bufsz < sizeof(seekto))
+            {
+                fuse_reply_err(req, EINVAL);
+                return;
+            }
+            memcpy(&seekto, in_buf, sizeof(seekto));
+            pthread_mutex_lock(&dev->lock);
+            new_pos = aesd_get_offset(&dev->buffer, seekto.write_cmd, seekto.write_cmd_offset);
+            if (new_pos >= 0)
+            {
+                file->pos = new_pos;
+            }
+            pthread_mutex_unlock(&dev->lock);
+            if (new_pos < 0)
+            {
+                fuse_reply_err(req, EINVAL);
+                return;
+            }
+            fuse_reply_ioctl(req, 0, &seekto, sizeof(seekto));
+            break;
+        case AESDCHAR_IOCGINFO:
+            memset(&info, 0, sizeof(info));
+            pthread_mutex_lock(&dev->lock);
+            info.entry_count = aesd_circular_buffer_entry_count(&dev->buffer);
+            pos = dev->buffer.out_offs;
+            for (idx = 0; idx < info.entry_count; idx++)
+            {
+                info.entry_size[idx] = dev->buffer.entry[pos].size;
+                info.total_bytes += dev->buffer.entry[pos].size;
+                pos = (pos + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+            }
+            pthread_mutex_unlock(&dev->lock);
+            fuse_reply_ioctl(req, 0, &info, sizeof(info));
+            break;
+        default:
+            fuse_reply_err(req, ENOTTY);
+            break;
+    }
+}
+
+static const struct cuse_lowlevel_ops aesd_cuse_ops = {
+    .open = aesd_cuse_open,
+    .release = aesd_cuse_release,
+    .read = aesd_cuse_read,
+    .write = aesd_cuse_write,
+    .ioctl = aesd_cuse_ioctl,
+};
+
+/**
+ * Command line options in addition to the standard fuse ones
+ */
+struct aesd_cuse_param
+{
+    char *dev_name;
+    int is_help;
+};
+
+#define AESD_CUSE_OPT(t, p) { t, offsetof(struct aesd_cuse_param, p), 1 }
+
+static const struct fuse_opt aesd_cuse_opts[] = {
+    AESD_CUSE_OPT("-n %s", dev_name),
+    AESD_CUSE_OPT("--name=%s", dev_name),
+    AESD_CUSE_OPT("-h", is_help),
+    AESD_CUSE_OPT("--help", is_help),
+    FUSE_OPT_END
+};
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct aesd_cuse_param param = { NULL, 0 };
+    struct cuse_info ci;
+    char dev_name[128];
+    const char *dev_info_argv[] = { dev_name };
+    struct aesd_buffer_entry *entry;
+    uint8_t idx;
+    int ret;
+
+    if (fuse_opt_parse(&args, &param, aesd_cuse_opts, NULL) != 0)
+    {
+        return 1;
+    }
+    if (param.is_help)
+    {
+        printf("Usage: %s [-f] [-s] [--name=NAME]\n"
+               "    -f            stay in the foreground\n"
+               "    -s            handle requests on a single thread\n"
+               "    --name=NAME   create /dev/NAME, aesdchar by default\n", argv[0]);
+        return 0;
+    }
+
+    snprintf(dev_name, sizeof(dev_name), "DEVNAME=%s", param.dev_name ? param.dev_name : "aesdchar");
+    memset(&ci, 0, sizeof(ci));
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = dev_info_argv;
+
+    aesd_circular_buffer_init(&aesd_cuse_device.buffer);
+    ret = cuse_lowlevel_main(args.argc, args.argv, &ci, &aesd_cuse_ops, NULL);
+
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &aesd_cuse_device.buffer, idx) {
+        if (!aesd_circular_buffer_entry_is_inline(&aesd_cuse_device.buffer, entry))
+        {
+            free((char *)entry->buffptr);
+        }
+    }
+    free(aesd_cuse_device.write_buf);
+    fuse_opt_free_args(&args);
+    return ret;
+}
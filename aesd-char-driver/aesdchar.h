@@ -8,8 +8,20 @@
 #ifndef AESD_CHAR_DRIVER_AESDCHAR_H_
 #define AESD_CHAR_DRIVER_AESDCHAR_H_
 #include "aesd-circular-buffer.h"
+#include "aesd-byte-ring.h"
 #include "aesd_ioctl.h"
-#define AESD_DEBUG 1  //Remove comment on this line to enable debug
+//#define AESD_DEBUG 1  //Remove comment on this line to enable debug
+
+/**
+ * Completed records up to this many bytes are copied into an object from the
+ * payload slab cache so the staging buffer can be reused for the next record.
+ * Larger records take over the staging buffer instead of being copied.
+ */
+#define AESD_SMALL_PAYLOAD_SIZE 128
+/**
+ * Smallest capacity allocated for the staging buffer, it grows geometrically from here
+ */
+#define AESD_MIN_STAGING_SIZE 64
 
 #undef PDEBUG             /* undef it, just in case */
 #ifdef AESD_DEBUG
@@ -25,6 +37,28 @@
 #endif
 
 
+/**
+ * Number of buckets in the latency histograms, bucket n counts calls which took
+ * [2^(n-1), 2^n) nanoseconds and the last bucket also counts anything slower
+ */
+#define AESD_LATENCY_BUCKETS 32
+
+/**
+ * Statistics kept per CPU so the hot paths never share a cache line,
+ * summed when read through debugfs
+ */
+struct aesd_stats
+{
+     u64 bytes_written; //bytes accepted by write calls
+     u64 records_written; //records added to the circular buffer
+     u64 entries_evicted; //records dropped to make room for new ones
+     u64 lock_acquisitions; //number of times the device lock was taken
+     u64 lock_wait_ns; //total time spent waiting for the device lock
+     u64 lock_hold_ns; //total time the device lock was held
+     u64 read_latency[AESD_LATENCY_BUCKETS]; //histogram of read call durations
+     u64 write_latency[AESD_LATENCY_BUCKETS]; //histogram of write call durations
+};
+
 struct aesd_dev
 {
     /**
@@ -33,10 +67,39 @@ struct aesd_dev
      struct cdev cdev; //character device structure
      struct mutex lock; //mutex lock
      struct aesd_circular_buffer buffer;  //circular buffer structure
-     char *write_buf; //write buffer
-     size_t write_buf_size; 
-     size_t buf_size; //size of circular buffer
+     struct aesd_byte_ring ring; //payload storage when aesd_ring_bytes is set, unused otherwise
+     size_t ring_offset[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED]; //offset in ring of the record of each buffer slot
+     char *write_buf; //staging buffer for the partial record
+     size_t write_buf_size; //bytes of the partial record held in write_buf
+     size_t write_buf_capacity; //bytes allocated for write_buf
+     size_t buf_size; //bytes stored in the circular buffer, kept equal to aesd_get_total_size()
+     wait_queue_head_t read_queue; //woken each time a record completes
+     u64 records_completed; //number of records added to the circular buffer
+     u64 bytes_evicted; //number of bytes dropped from the front of the circular buffer
+     struct aesd_stats __percpu *stats; //statistics exposed through debugfs
+     u64 lock_acquired_ns; //time the current holder took the lock, used for hold time
+     struct dentry *debugfs_dir; //debugfs directory of this device
+
+};
 
+/**
+ * Per open file state, stored in filp->private_data
+ */
+struct aesd_file
+{
+     struct aesd_dev *dev; //device this file was opened on
+     bool follow; //block in read at end of data until the next record completes
+     u64 bytes_evicted; //dev->bytes_evicted when f_pos was last rebased, used in follow mode
+     /**
+      * Read cursor cached at the end of the last read so sequential reads resume in O(1).
+      * Only used while f_pos still equals cursor_pos and dev->bytes_evicted still equals
+      * cursor_generation, i.e. there was no seek and no eviction since.
+      */
+     bool cursor_valid;
+     loff_t cursor_pos; //file position described by the cursor
+     uint8_t cursor_cmd; //index of the record at cursor_pos, counting from the oldest record
+     size_t cursor_offset; //offset of cursor_pos within that record
+     u64 cursor_generation; //dev->bytes_evicted when the cursor was cached
 };
 
 
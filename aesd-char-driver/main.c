@@ -17,271 +17,839 @@
 #include <linux/types.h>
 #include <linux/cdev.h>
 #include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/version.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/timekeeping.h>
+#include <linux/mm.h>
 #include "aesdchar.h"
 #include "aesd_ioctl.h"
 #include "linux/slab.h"
 
+#define CREATE_TRACE_POINTS
+#include "aesd_trace.h"
+
 int aesd_major =   0; // use dynamic major
 int aesd_minor =   0;
+unsigned int aesd_nr_devs = 1; // number of independent devices to create
+module_param(aesd_nr_devs, uint, 0444);
+MODULE_PARM_DESC(aesd_nr_devs, "Number of aesdchar devices, each with its own circular buffer and lock");
+unsigned long aesd_max_bytes = 0; // byte budget for the records of each device, 0 for no limit
+module_param(aesd_max_bytes, ulong, 0644);
+MODULE_PARM_DESC(aesd_max_bytes, "Evict the oldest records of a device until a new record fits in this many bytes, 0 for no limit");
+unsigned long aesd_ring_bytes = 0; // size of the payload byte ring of each device, 0 for one allocation per record
+module_param(aesd_ring_bytes, ulong, 0444);
+MODULE_PARM_DESC(aesd_ring_bytes, "Store the records of each device back to back in a byte ring of this size, 0 to allocate each record separately");
 
 MODULE_AUTHOR("Tommy Ramirez"); /** TODO: fill in your name **/
 MODULE_LICENSE("Dual BSD/GPL");
 
-struct aesd_dev aesd_device;
+struct aesd_dev *aesd_devices; // array of aesd_nr_devs devices
+static struct kmem_cache *aesd_payload_cache; // slab cache for small record payloads
+static struct dentry *aesd_debugfs_root; // debugfs directory holding one directory per device
+
+/**
+ * Take the lock of @param dev, accounting the time spent waiting for it
+ * @return 0 on success or -ERESTARTSYS if interrupted by a signal
+ */
+static int aesd_lock(struct aesd_dev *dev)
+{
+    u64 start = ktime_get_ns();
+
+    if(mutex_lock_interruptible(&dev->lock) != 0)
+    {
+        PDEBUG("Error: mutex could not lock properly");
+        return -ERESTARTSYS;
+    }
+    dev->lock_acquired_ns = ktime_get_ns();
+    this_cpu_inc(dev->stats->lock_acquisitions);
+    this_cpu_add(dev->stats->lock_wait_ns, dev->lock_acquired_ns - start);
+    return 0;
+}
+
+/**
+ * Release the lock of @param dev taken with aesd_lock(), accounting the time it was held
+ */
+static void aesd_unlock(struct aesd_dev *dev)
+{
+    this_cpu_add(dev->stats->lock_hold_ns, ktime_get_ns() - dev->lock_acquired_ns);
+    mutex_unlock(&dev->lock);
+}
+
+/**
+ * Count a call which took @param elapsed nanoseconds in the latency histogram @param histogram
+ */
+static void aesd_account_latency(u64 __percpu *histogram, u64 elapsed)
+{
+    unsigned int bucket = elapsed ? fls64(elapsed) : 0;
+
+    if(bucket >= AESD_LATENCY_BUCKETS)
+    {
+        bucket = AESD_LATENCY_BUCKETS - 1;
+    }
+    this_cpu_inc(histogram[bucket]);
+}
 
 int aesd_open(struct inode *inode, struct file *filp)
 {
+    struct aesd_file *file;
     PDEBUG("open");
-    /**
-     * TODO: handle open
-     */
-    filp->private_data = container_of(inode->i_cdev, struct aesd_dev, cdev);
+    file = kzalloc(sizeof(*file), GFP_KERNEL);
+    if(!file)
+    {
+        return -ENOMEM;
+    }
+    file->dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
+    filp->private_data = file;
     return 0;
 }
 
 int aesd_release(struct inode *inode, struct file *filp)
 {
     PDEBUG("release");
-    /**
-     * TODO: handle release
-     */
+    kfree(filp->private_data);
     filp->private_data = NULL;
     return 0;
 }
 
-ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
-                loff_t *f_pos)
+/**
+ * Move @param pos back by the number of bytes evicted since @param file last looked,
+ * so a follower keeps pointing at the same byte of data.  Caller must hold the device lock.
+ * @return the rebased position
+ */
+static loff_t aesd_follow_pos(struct aesd_file *file, loff_t pos)
 {
-    ssize_t retval = 0;
-    size_t  remainder;
-    size_t  copy_num;
+    u64 evicted = file->dev->bytes_evicted - file->bytes_evicted;
+
+    if((u64)pos > evicted)
+    {
+        return pos - evicted;
+    }
+    return 0;
+}
+
+/**
+ * Find the record holding file position @param pos for @param file.  Resumes from the cursor
+ * cached by the previous read when it describes @param pos and nothing was evicted since,
+ * otherwise walks the circular buffer from the oldest record.
+ * Caller must hold the device lock.
+ * @param cmd set to the index of the record counting from the oldest one
+ * @param offset set to the offset of @param pos within that record
+ * @return true if data is available at @param pos
+ */
+static bool aesd_cursor_lookup(struct aesd_file *file, loff_t pos, uint8_t *cmd, size_t *offset)
+{
+    struct aesd_dev *dev = file->dev;
     struct aesd_buffer_entry *entry;
-    size_t offset = 0;
-    struct aesd_dev *cir_buff = filp->private_data;
-    PDEBUG("read %zu bytes with offset %lld",count,*f_pos);
-    /**
-     * TODO: handle read
-     */
+    uint8_t count = aesd_circular_buffer_entry_count(&dev->buffer);
 
+    // any eviction changes bytes_evicted and renumbers the records
+    if(file->cursor_valid && file->cursor_pos == pos &&
+            file->cursor_generation == dev->bytes_evicted)
+    {
+        *cmd = file->cursor_cmd;
+        *offset = file->cursor_offset;
+        return *cmd < count;
+    }
 
-    if(!filp || !buf || !f_pos) // invalid inputs
+    entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, pos, offset);
+    if(!entry)
     {
-        PDEBUG("Error: invalid inputs");
-        return -EINTR;
+        return false;
     }
-    
+    *cmd = (entry - dev->buffer.entry + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - dev->buffer.out_offs)
+            % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    return true;
+}
 
-    if(mutex_lock_interruptible(&cir_buff->lock) != 0)
+/**
+ * @return true if @param dev stores its records in a byte ring, see aesd_ring_bytes
+ */
+static bool aesd_ring_mode(struct aesd_dev *dev)
+{
+    return dev->ring.data != NULL;
+}
+
+/**
+ * Find the data at file position @param pos for @param file, see aesd_cursor_lookup().
+ * In byte ring mode the records are contiguous, so only the position is checked, ring records
+ * have no buffptr and must not be looked up with aesd_circular_buffer_find_entry_offset_for_fpos().
+ * Caller must hold the device lock.
+ * @return true if data is available at @param pos
+ */
+static bool aesd_read_lookup(struct aesd_file *file, loff_t pos, uint8_t *cmd, size_t *offset)
+{
+    if(aesd_ring_mode(file->dev))
+    {
+        return pos < file->dev->buf_size;
+    }
+    return aesd_cursor_lookup(file, pos, cmd, offset);
+}
+
+/**
+ * Copy the @param len bytes starting at @param offset in the byte ring of @param dev
+ * into @param to, with one copy or two when the range wraps around the end of the ring.
+ * Caller must hold the device lock.
+ * @return the number of bytes copied
+ */
+static size_t aesd_ring_copy_to_iter(struct aesd_dev *dev, size_t offset, size_t len, struct iov_iter *to)
+{
+    struct aesd_byte_ring_span spans[2];
+    unsigned int nr_spans = aesd_byte_ring_spans(&dev->ring, offset, len, spans);
+    unsigned int i;
+    size_t copied = 0;
+    size_t done;
+
+    for(i = 0; i < nr_spans; i++)
+    {
+        done = copy_to_iter(spans[i].ptr, spans[i].len, to);
+        copied += done;
+        if(done != spans[i].len)
+        {
+            break;
+        }
+    }
+    return copied;
+}
+
+/**
+ * Copy data starting at @param f_pos into @param to, continuing across records until
+ * @param to is full or the end of the circular buffer is reached.  The whole request is
+ * handled under a single acquisition of the device lock.
+ * In follow mode waits for a record at the end of data unless @param nonblock is set.
+ * @return the number of bytes copied or a negative error
+ */
+static ssize_t aesd_read(struct file *filp, struct iov_iter *to, loff_t *f_pos, bool nonblock)
+{
+    ssize_t retval = 0;
+    size_t  copy_num;
+    size_t  copied;
+    struct aesd_buffer_entry *entry;
+    size_t offset = 0;
+    uint8_t cmd = 0;
+    uint8_t count;
+    bool found;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *cir_buff = file->dev;
+    u64 records_completed;
+    PDEBUG("read %zu bytes with offset %lld",iov_iter_count(to),*f_pos);
+
+    if(aesd_lock(cir_buff) != 0)
     {
         PDEBUG("Error: mutex could not lock properly");
         return -ERESTARTSYS; 
     }
 
-    entry = aesd_circular_buffer_find_entry_offset_for_fpos(&cir_buff->buffer, *f_pos, &offset);
+    if(file->follow)
+    {
+        *f_pos = aesd_follow_pos(file, *f_pos);
+        file->bytes_evicted = cir_buff->bytes_evicted;
+    }
+
+    found = aesd_read_lookup(file, *f_pos, &cmd, &offset);
 
-    if(entry)
+    // in follow mode wait for the next record instead of reporting end of file
+    while(!found && file->follow)
     {
-        remainder = entry->size - offset;
-        copy_num = remainder;
-        if(copy_num > count)
+        if(nonblock)
+        {
+            retval = -EAGAIN;
+            goto unlock;
+        }
+        records_completed = cir_buff->records_completed;
+        aesd_unlock(cir_buff);
+
+        if(wait_event_interruptible(cir_buff->read_queue,
+                    READ_ONCE(cir_buff->records_completed) != records_completed))
         {
-            copy_num = count;
+            return -ERESTARTSYS;
         }
-        if (copy_to_user(buf, entry->buffptr + offset, copy_num))
+        if(aesd_lock(cir_buff) != 0)
+        {
+            return -ERESTARTSYS;
+        }
+        *f_pos = aesd_follow_pos(file, *f_pos);
+        file->bytes_evicted = cir_buff->bytes_evicted;
+        found = aesd_read_lookup(file, *f_pos, &cmd, &offset);
+    }
+    if(!found)
+    {
+        goto unlock;
+    }
+
+    if(aesd_ring_mode(cir_buff))
+    {
+        // consecutive records are contiguous in the ring, copy the whole range at once
+        copy_num = min_t(size_t, cir_buff->buf_size - *f_pos, iov_iter_count(to));
+        copied = aesd_ring_copy_to_iter(cir_buff, aesd_byte_ring_offset(&cir_buff->ring, *f_pos),
+                copy_num, to);
+        *f_pos += copied;
+        retval = (copied == 0 && copy_num) ? -EFAULT : copied;
+        goto unlock;
+    }
+
+    count = aesd_circular_buffer_entry_count(&cir_buff->buffer);
+    while(cmd < count && iov_iter_count(to))
+    {
+        entry = &cir_buff->buffer.entry[(cir_buff->buffer.out_offs + cmd) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+        copy_num = min(entry->size - offset, iov_iter_count(to));
+        copied = copy_to_iter(entry->buffptr + offset, copy_num, to);
+        retval += copied;
+        *f_pos += copied;
+        offset += copied;
+        if(copied != copy_num)
         {
             PDEBUG("Error some bytes could not be copied");
-            retval = -EFAULT;
+            if(retval == 0)
+            {
+                retval = -EFAULT;
+            }
+            break;
         }
-        else
+        if(offset == entry->size)
         {
-            retval = copy_num;
-            *f_pos += retval;
+            // move on to the next record in logical order
+            cmd++;
+            offset = 0;
         }
     }
 
-    mutex_unlock(&cir_buff->lock);
+    // remember where this read stopped so a sequential read resumes without a lookup
+    file->cursor_valid = true;
+    file->cursor_pos = *f_pos;
+    file->cursor_cmd = cmd;
+    file->cursor_offset = offset;
+    file->cursor_generation = cir_buff->bytes_evicted;
+
+unlock:
+    aesd_unlock(cir_buff);
     return retval;
 }
 
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
-                loff_t *f_pos)
+static ssize_t aesd_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-    ssize_t retval = -ENOMEM;
-    struct aesd_dev *cir_buff = filp->private_data;
-    bool newline_exists = false;
-    char *write_data_buffer = NULL;
-    size_t idx;
-    size_t append_idx = 0;
+    struct file *filp = iocb->ki_filp;
+    struct aesd_file *file = filp->private_data;
+    u64 start = ktime_get_ns();
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(to);
+    ssize_t retval;
+    u64 elapsed;
 
-    PDEBUG("write %zu bytes with offset %lld", count, *f_pos);
-    /**
-     * TODO: handle write
-     */
-    if(!filp || !buf || !f_pos) // invalid inputs
+    retval = aesd_read(filp, to, &iocb->ki_pos,
+            (filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT));
+    elapsed = ktime_get_ns() - start;
+    aesd_account_latency(file->dev->stats->read_latency, elapsed);
+    trace_aesd_read(MINOR(file->dev->cdev.dev), pos, count, retval, elapsed);
+    return retval;
+}
+
+/**
+ * Report the device readable when data is available at the current file position
+ * and always writable.  Waiters are woken each time a record completes.
+ */
+static __poll_t aesd_poll(struct file *filp, poll_table *wait)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+    loff_t pos;
+
+    poll_wait(filp, &dev->read_queue, wait);
+
+    if(aesd_lock(dev) != 0)
     {
-        PDEBUG("Error: invalid inputs");
-        return -EINTR;
+        return mask;
     }
-    if (count == 0)
+    pos = file->follow ? aesd_follow_pos(file, filp->f_pos) : filp->f_pos;
+    if(pos < aesd_get_total_size(&dev->buffer))
+    {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    aesd_unlock(dev);
+    return mask;
+}
+
+/**
+ * Release the payload referenced by @param entry of @param dev using the allocator it came from,
+ * inline records and records in the byte ring have nothing to release.
+ * Caller must hold the device lock.
+ */
+static void aesd_free_payload(struct aesd_dev *dev, struct aesd_buffer_entry *entry)
+{
+    if(entry->buffptr && !aesd_circular_buffer_entry_is_inline(&dev->buffer, entry) && !aesd_ring_mode(dev))
+    {
+        if(entry->size <= AESD_SMALL_PAYLOAD_SIZE)
+        {
+            kmem_cache_free(aesd_payload_cache, (void *)entry->buffptr);
+        }
+        else
+        {
+            kfree(entry->buffptr);
+        }
+    }
+    entry->buffptr = NULL;
+    entry->size = 0;
+}
+
+/**
+ * Remove the oldest record of @param dev from the circular buffer and free it,
+ * keeping the byte accounting of the device in step.
+ * Caller must hold the device lock.
+ */
+static void aesd_evict_oldest(struct aesd_dev *dev)
+{
+    struct aesd_buffer_entry oldest;
+
+    if(!aesd_circular_buffer_remove_entry(&dev->buffer, &oldest))
+    {
+        return;
+    }
+    dev->buf_size -= oldest.size;
+    dev->bytes_evicted += oldest.size;
+    trace_aesd_evict(MINOR(dev->cdev.dev), oldest.size, dev->bytes_evicted);
+    if(aesd_ring_mode(dev))
+    {
+        // the oldest record is always at the start of the ring
+        aesd_byte_ring_consume(&dev->ring, oldest.size);
+    }
+    aesd_free_payload(dev, &oldest);
+    this_cpu_inc(dev->stats->entries_evicted);
+}
+
+/**
+ * Make sure the staging buffer of @param dev can hold at least @param needed bytes.
+ * Capacity grows geometrically so a record assembled from many small writes
+ * is reallocated O(log n) times instead of once per write.
+ * Caller must hold the device lock.
+ */
+static int aesd_reserve_staging(struct aesd_dev *dev, size_t needed)
+{
+    size_t capacity;
+    char *staging;
+
+    if(needed <= dev->write_buf_capacity)
     {
         return 0;
     }
-    write_data_buffer = kmalloc(count, GFP_KERNEL); // allocate memory for write buffer
-    if(!write_data_buffer)
+    capacity = max_t(size_t, dev->write_buf_capacity * 2, AESD_MIN_STAGING_SIZE);
+    capacity = max_t(size_t, capacity, needed);
+    staging = krealloc(dev->write_buf, capacity, GFP_KERNEL);
+    if(!staging)
     {
-        PDEBUG("Error: malloc failed");
-        retval = -ENOMEM;
-        return retval;
+        return -ENOMEM;
     }
+    dev->write_buf = staging;
+    dev->write_buf_capacity = capacity;
+    return 0;
+}
 
-    if (copy_from_user(write_data_buffer, buf, count))
+/**
+ * Append the @param size bytes at @param start in the staging buffer to the byte ring of
+ * @param dev as a completed record, evicting the oldest records until it fits, with the same
+ * limits as aesd_complete_record().  Eviction only moves the start of the ring.
+ * The record may wrap around the end of the ring, so @param entry gets no buffptr, the offset
+ * of the record is kept in ring_offset for the slot it is about to be added to.
+ * Caller must hold the device lock.
+ */
+static int aesd_complete_ring_record(struct aesd_dev *dev, size_t start, size_t size,
+            struct aesd_buffer_entry *entry)
+{
+    unsigned long max_bytes = READ_ONCE(aesd_max_bytes);
+    size_t offset;
+
+    if(size > dev->ring.capacity)
     {
-        PDEBUG("Error some bytes could not be copied");
-        retval = -EFAULT;
-        kfree(write_data_buffer);
-        mutex_unlock(&cir_buff->lock);
-        return retval;
+        return -EFBIG;
     }
-    
-    if(mutex_lock_interruptible(&cir_buff->lock) != 0)
+    while(dev->buffer.full || size > aesd_byte_ring_space(&dev->ring) ||
+            (max_bytes && dev->buf_size && dev->buf_size + size > max_bytes))
     {
-        PDEBUG("Error: mutex could not lock properly");
-        return -ERESTARTSYS; 
+        aesd_evict_oldest(dev);
     }
-    
-    
-    for(idx = 0; idx < count; idx++) // check if newline exists in the write buffer
+    aesd_byte_ring_append(&dev->ring, dev->write_buf + start, size, &offset);
+    dev->ring_offset[dev->buffer.in_offs] = offset;
+    entry->buffptr = NULL;
+    entry->size = size;
+    return 0;
+}
+
+/**
+ * Add the @param size bytes at @param start in the staging buffer to the circular buffer
+ * as a completed record.  Evicts the oldest records while the buffer is full or the stored
+ * bytes would exceed aesd_max_bytes, a record larger than aesd_max_bytes is kept on its own.
+ * Records of up to AESD_INLINE_RECORD_SIZE bytes are copied into the circular buffer itself,
+ * other small records are copied into a slab object so the staging buffer is kept for reuse.
+ * In byte ring mode every record is appended to the ring instead.
+ * A large record which is the whole staged data takes ownership of the staging buffer,
+ * other large records are copied into their own allocation.
+ * The caller is responsible for dropping the record from the staging buffer.
+ * Caller must hold the device lock.
+ */
+static int aesd_complete_record(struct aesd_dev *dev, size_t start, size_t size)
+{
+    struct aesd_buffer_entry entry;
+    char *payload;
+    bool inline_record = false;
+    unsigned long max_bytes;
+    int err;
+
+    if(aesd_ring_mode(dev))
     {
-        if(write_data_buffer[idx] == '\n')
+        err = aesd_complete_ring_record(dev, start, size, &entry);
+        if(err)
         {
-            newline_exists = true;
-            break;
+            return err;
         }
+        payload = NULL;
     }
-
-    if(newline_exists == true) // if newline exists, append the write buffer to the circular buffer
+    else if(AESD_INLINE_RECORD_SIZE > 0 && size <= AESD_INLINE_RECORD_SIZE)
     {
-        append_idx = idx + 1;
-        PDEBUG("Write data is %s", write_data_buffer);
+        // copied once the oldest record no longer uses the inline slot
+        inline_record = true;
+        payload = NULL;
+        entry.buffptr = NULL;
+        entry.size = size;
+    }
+    else if(size <= AESD_SMALL_PAYLOAD_SIZE)
+    {
+        payload = kmem_cache_alloc(aesd_payload_cache, GFP_KERNEL);
+        if(!payload)
+        {
+            return -ENOMEM;
+        }
+        memcpy(payload, dev->write_buf + start, size);
+    }
+    else if(start == 0 && size == dev->write_buf_size)
+    {
+        payload = dev->write_buf;
+        dev->write_buf = NULL;
+        dev->write_buf_capacity = 0;
+        dev->write_buf_size = 0;
     }
     else
     {
-        append_idx = count;
-        PDEBUG("Write data is %s", write_data_buffer);
+        payload = kmalloc(size, GFP_KERNEL);
+        if(!payload)
+        {
+            return -ENOMEM;
+        }
+        memcpy(payload, dev->write_buf + start, size);
+    }
+    if(payload)
+    {
+        entry.buffptr = payload;
+        entry.size = size;
     }
-    
-    // if write buffer is empty, allocate memory for write buffer
-    if(cir_buff->write_buf_size == 0)
+
+    max_bytes = READ_ONCE(aesd_max_bytes);
+    while(dev->buffer.full ||
+            (max_bytes && dev->buf_size && dev->buf_size + entry.size > max_bytes))
+    {
+        aesd_evict_oldest(dev);
+    }
+    if(inline_record)
     {
-        cir_buff->write_buf = kmalloc(count, GFP_KERNEL);
+        aesd_circular_buffer_add_inline(&dev->buffer, dev->write_buf + start, size);
     }
     else
     {
-        cir_buff->write_buf = krealloc(cir_buff->write_buf, (append_idx + cir_buff->write_buf_size), GFP_KERNEL);
+        aesd_circular_buffer_add_entry(&dev->buffer, &entry); // add entry to buffer
     }
-    if(cir_buff->write_buf == NULL) 
+    dev->buf_size += entry.size; // update buffer size
+    dev->records_completed++;
+    this_cpu_inc(dev->stats->records_written);
+    trace_aesd_record_complete(MINOR(dev->cdev.dev), entry.size,
+            aesd_circular_buffer_entry_count(&dev->buffer), dev->buf_size);
+    wake_up_interruptible_poll(&dev->read_queue, EPOLLIN | EPOLLRDNORM);
+    return 0;
+}
+
+/**
+ * Append the data in @param from to the partial record of the device open in @param filp,
+ * adding a record to the circular buffer for each newline found.  The whole request is
+ * handled under a single acquisition of the device lock.
+ * @return the number of bytes consumed or a negative error
+ */
+static ssize_t aesd_write(struct file *filp, struct iov_iter *from, loff_t *f_pos)
+{
+    ssize_t retval;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *cir_buff = file->dev;
+    size_t count = iov_iter_count(from);
+    size_t staged_size;
+    size_t record_start = 0;
+    size_t scan;
+    char *newline;
+
+    PDEBUG("write %zu bytes with offset %lld", count, *f_pos);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    if(aesd_lock(cir_buff) != 0)
     {
-        kfree(write_data_buffer);
+        PDEBUG("Error: mutex could not lock properly");
+        return -ERESTARTSYS; 
+    }
+
+    staged_size = cir_buff->write_buf_size;
+    retval = aesd_reserve_staging(cir_buff, staged_size + count);
+    if(retval)
+    {
+        PDEBUG("Error: staging buffer allocation failed");
+        goto unlock;
+    }
+
+    // copy straight behind the partial record already staged
+    if (copy_from_iter(cir_buff->write_buf + staged_size, count, from) != count)
+    {
+        PDEBUG("Error some bytes could not be copied");
         retval = -EFAULT;
-        mutex_unlock(&cir_buff->lock);
-        return retval;
-    }    
-    memcpy(cir_buff->write_buf + cir_buff->write_buf_size, write_data_buffer, append_idx); 
-    cir_buff->write_buf_size += append_idx; // update write buffer size
-
- 
-    // if newline exists, add the write buffer to the circular buffer
-    if(newline_exists)
-    {
-        struct aesd_buffer_entry entry;
-        struct aesd_buffer_entry *to_be_freed = NULL;
-        entry.size = cir_buff->write_buf_size;
-        entry.buffptr = cir_buff->write_buf;
-
-        if(cir_buff->buffer.full) // if buffer is full, free the oldest entry
+        goto unlock;
+    }
+    cir_buff->write_buf_size = staged_size + count;
+
+    // every newline terminates a record
+    scan = staged_size;
+    while(cir_buff->write_buf &&
+            (newline = memchr(cir_buff->write_buf + scan, '\n', cir_buff->write_buf_size - scan)))
+    {
+        size_t record_end = (size_t)(newline - cir_buff->write_buf) + 1;
+
+        retval = aesd_complete_record(cir_buff, record_start, record_end - record_start);
+        if(retval)
         {
-            to_be_freed = &cir_buff->buffer.entry[cir_buff->buffer.out_offs]; // get the oldest entry
-            if(to_be_freed->buffptr) // free the buffer if it exists
-            {
-                kfree(to_be_freed->buffptr);
-            }
-            to_be_freed->buffptr = NULL;
-            to_be_freed->size = 0;
+            PDEBUG("Error: record allocation failed");
+            break;
         }
-        aesd_circular_buffer_add_entry(&cir_buff->buffer, &entry); // add entry to buffer
-        cir_buff->buf_size += entry.size; // update buffer size
+        record_start = scan = record_end;
+    }
+
+    if(retval && record_start == 0)
+    {
+        // nothing was consumed, keep the partial record as it was before this write
+        cir_buff->write_buf_size = staged_size;
+        goto unlock;
+    }
+    if(retval)
+    {
+        // report the bytes up to the last completed record, the rest was not consumed
         cir_buff->write_buf_size = 0;
-    }   
-    
-    retval = append_idx; // return the number of bytes written
-    
-    // free write_data_buffer
-    if(write_data_buffer)
+        retval = record_start - staged_size;
+        this_cpu_add(cir_buff->stats->bytes_written, retval);
+        goto unlock;
+    }
+
+    // keep whatever follows the last newline as the new partial record
+    if(cir_buff->write_buf && record_start)
     {
-        kfree(write_data_buffer);
+        cir_buff->write_buf_size -= record_start;
+        memmove(cir_buff->write_buf, cir_buff->write_buf + record_start, cir_buff->write_buf_size);
     }
+    retval = count; // return the number of bytes written
+    this_cpu_add(cir_buff->stats->bytes_written, count);
 
-    mutex_unlock(&cir_buff->lock);
+unlock:
+    aesd_unlock(cir_buff);
+    return retval;
+}
+
+static ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct aesd_file *file = iocb->ki_filp->private_data;
+    u64 start = ktime_get_ns();
+    loff_t pos = iocb->ki_pos;
+    size_t count = iov_iter_count(from);
+    ssize_t retval;
+    u64 elapsed;
+
+    retval = aesd_write(iocb->ki_filp, from, &iocb->ki_pos);
+    elapsed = ktime_get_ns() - start;
+    aesd_account_latency(file->dev->stats->write_latency, elapsed);
+    trace_aesd_write(MINOR(file->dev->cdev.dev), pos, count, retval, elapsed);
     return retval;
 }
 
 loff_t llseek(struct file * filp, loff_t offset, int whence)
 {
 
-    struct aesd_dev *ptr_to_size = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *ptr_to_size = file->dev;
     loff_t fixed_output;
-    if(mutex_lock_interruptible(&(aesd_device.lock)) != 0) //lock mutex
+    if(aesd_lock(ptr_to_size) != 0) //lock mutex
     {
         PDEBUG("Error: mutex could not lock properly");
         return -ERESTARTSYS; 
     }
     fixed_output = fixed_size_llseek(filp, offset, whence, ptr_to_size->buf_size);
-    mutex_unlock(&(aesd_device.lock));
+    file->bytes_evicted = ptr_to_size->bytes_evicted;
+    aesd_unlock(ptr_to_size);
     return fixed_output;
 }
 
 static long aesd_adjust_file_offset(struct file *filp, unsigned int write_cmd, unsigned int write_cmd_offset)
 {
     long retval = 0;
-    loff_t new_f_pos;
-    unsigned int i = 0;
-    struct aesd_dev *cir_buff = NULL;
-    if(write_cmd >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) 
-    {
-        PDEBUG("Error: write_cmd too big");
-        return -EINVAL;
-    }
+    long new_f_pos;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *cir_buff = file->dev;
 
-    if(mutex_lock_interruptible(&(aesd_device.lock)) != 0) 
+    if(aesd_lock(cir_buff) != 0) 
     {
         PDEBUG("Error: mutex could not lock properly");
         return -ERESTARTSYS; 
     }
-    cir_buff = filp->private_data;
-    
-    if(write_cmd_offset >= cir_buff->buffer.entry[write_cmd].size)
+
+    // write_cmd counts from the oldest record, wherever it sits in the entry array
+    new_f_pos = aesd_get_offset(&cir_buff->buffer, write_cmd, write_cmd_offset);
+    if(new_f_pos < 0)
     {
-        PDEBUG("Error: too big for write_cmd");
+        PDEBUG("Error: write_cmd %u offset %u out of range", write_cmd, write_cmd_offset);
         retval = -EINVAL;
         goto unlock;
-    }    
-
-    new_f_pos = 0;
-    for(i = 0; i < write_cmd; i++)
-    {
-        new_f_pos += (loff_t)cir_buff->buffer.entry[i].size;
     }
-    new_f_pos += (loff_t)write_cmd_offset;
     filp->f_pos = new_f_pos;
+    file->bytes_evicted = cir_buff->bytes_evicted;
     unlock:
-    mutex_unlock(&(aesd_device.lock));
+    aesd_unlock(cir_buff);
+    trace_aesd_adjust_file_offset(MINOR(cir_buff->cdev.dev), write_cmd, write_cmd_offset,
+            filp->f_pos, retval);
+    return retval;
+}
+
+/**
+ * Fill in @param info with the record count, each record size and the total size
+ * of the device open in @param filp, all sampled under one acquisition of the device lock
+ */
+static long aesd_get_info(struct file *filp, struct aesd_info *info)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    uint8_t idx;
+    uint8_t pos;
+
+    memset(info, 0, sizeof(*info));
+    if(aesd_lock(dev) != 0)
+    {
+        return -ERESTARTSYS;
+    }
+    info->entry_count = aesd_circular_buffer_entry_count(&dev->buffer);
+    pos = dev->buffer.out_offs;
+    for(idx = 0; idx < info->entry_count; idx++)
+    {
+        info->entry_size[idx] = dev->buffer.entry[pos].size;
+        info->total_bytes += dev->buffer.entry[pos].size;
+        pos = (pos + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+    aesd_unlock(dev);
+    return 0;
+}
+
+/**
+ * Copy the payload of the record in slot @param pos of the circular buffer of @param dev
+ * to @param dest
+ * @return 0 on success or -EFAULT
+ */
+static int aesd_copy_record_to_user(struct aesd_dev *dev, uint8_t pos, char __user *dest)
+{
+    const struct aesd_buffer_entry *entry = &dev->buffer.entry[pos];
+    struct aesd_byte_ring_span spans[2];
+    unsigned int nr_spans;
+    unsigned int i;
+
+    if(!aesd_ring_mode(dev))
+    {
+        return copy_to_user(dest, entry->buffptr, entry->size) ? -EFAULT : 0;
+    }
+    nr_spans = aesd_byte_ring_spans(&dev->ring, dev->ring_offset[pos], entry->size, spans);
+    for(i = 0; i < nr_spans; i++)
+    {
+        if(copy_to_user(dest, spans[i].ptr, spans[i].len))
+        {
+            return -EFAULT;
+        }
+        dest += spans[i].len;
+    }
+    return 0;
+}
+
+/**
+ * Copy the whole records described by @param snapshot to its user buffer, holding the device
+ * lock for the duration so the copy is consistent with a single point in time.
+ * Updates cmd_count and bytes_copied in @param snapshot with what was copied.
+ */
+static long aesd_snapshot(struct file *filp, struct aesd_snapshot *snapshot)
+{
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    char __user *dest = u64_to_user_ptr(snapshot->buf);
+    uint32_t max_count = snapshot->cmd_count;
+    uint8_t entry_count;
+    uint8_t idx;
+    uint8_t pos;
+    long retval = 0;
+
+    snapshot->cmd_count = 0;
+    snapshot->bytes_copied = 0;
+    if(aesd_lock(dev) != 0)
+    {
+        return -ERESTARTSYS;
+    }
+
+    entry_count = aesd_circular_buffer_entry_count(&dev->buffer);
+    if(snapshot->first_cmd > entry_count)
+    {
+        retval = -EINVAL;
+        goto unlock;
+    }
+
+    pos = (dev->buffer.out_offs + snapshot->first_cmd) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    for(idx = snapshot->first_cmd; idx < entry_count; idx++)
+    {
+        const struct aesd_buffer_entry *entry = &dev->buffer.entry[pos];
+
+        if(max_count && snapshot->cmd_count == max_count)
+        {
+            break;
+        }
+        if(entry->size > snapshot->buf_len - snapshot->bytes_copied)
+        {
+            if(snapshot->cmd_count == 0)
+            {
+                retval = -ENOSPC;
+            }
+            break;
+        }
+        if(aesd_copy_record_to_user(dev, pos, dest + snapshot->bytes_copied))
+        {
+            retval = -EFAULT;
+            break;
+        }
+        snapshot->bytes_copied += entry->size;
+        snapshot->cmd_count++;
+        pos = (pos + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+
+unlock:
+    aesd_unlock(dev);
     return retval;
 }
 
 long ioctl_support(struct file * filp, unsigned int cmd, unsigned long arg)
 {
-    uint32_t retval = 0;
+    long retval = 0;
     struct aesd_seekto seekto;
+    struct aesd_info info;
+    struct aesd_snapshot snapshot;
+    struct aesd_file *file = filp->private_data;
+    uint32_t follow;
     if((_IOC_TYPE(cmd) != AESD_IOC_MAGIC) || (_IOC_NR(cmd) > AESDCHAR_IOC_MAXNR)) //check for invalid cmd
     {
         return -ENOTTY;
@@ -301,6 +869,41 @@ long ioctl_support(struct file * filp, unsigned int cmd, unsigned long arg)
                 retval = aesd_adjust_file_offset(filp, seekto.write_cmd, seekto.write_cmd_offset);
             }
             break;
+        case AESDCHAR_IOCSFOLLOW:
+            if(get_user(follow, (uint32_t __user *)arg) != 0)
+            {
+                retval = -EFAULT;
+            }
+            else if(aesd_lock(file->dev) != 0)
+            {
+                retval = -ERESTARTSYS;
+            }
+            else
+            {
+                file->follow = (follow != 0);
+                file->bytes_evicted = file->dev->bytes_evicted;
+                aesd_unlock(file->dev);
+            }
+            break;
+        case AESDCHAR_IOCGINFO:
+            retval = aesd_get_info(filp, &info);
+            if(retval == 0 && copy_to_user((void __user *)arg, &info, sizeof(info)) != 0)
+            {
+                retval = -EFAULT;
+            }
+            break;
+        case AESDCHAR_IOCSNAPSHOT:
+            if(copy_from_user(&snapshot, (const void __user *)arg, sizeof(snapshot)) != 0)
+            {
+                retval = -EFAULT;
+                break;
+            }
+            retval = aesd_snapshot(filp, &snapshot);
+            if(retval == 0 && copy_to_user((void __user *)arg, &snapshot, sizeof(snapshot)) != 0)
+            {
+                retval = -EFAULT;
+            }
+            break;
         default:
             retval = -ENOTTY;
             break;
@@ -309,54 +912,207 @@ long ioctl_support(struct file * filp, unsigned int cmd, unsigned long arg)
 }
 struct file_operations aesd_fops = {
     .owner =    THIS_MODULE,
-    .read =     aesd_read,
-    .write =    aesd_write,
+    .read_iter =    aesd_read_iter,
+    .write_iter =   aesd_write_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    .splice_read =  copy_splice_read,
+#else
+    .splice_read =  generic_file_splice_read,
+#endif
     .open =     aesd_open,
     .release =  aesd_release,
     .llseek =   llseek,
+    .poll =     aesd_poll,
     .unlocked_ioctl = ioctl_support
 };
 
-static int aesd_setup_cdev(struct aesd_dev *dev)
+/**
+ * Sum the per CPU statistics of @param dev into @param total
+ */
+static void aesd_sum_stats(struct aesd_dev *dev, struct aesd_stats *total)
+{
+    int cpu;
+    unsigned int i;
+
+    memset(total, 0, sizeof(*total));
+    for_each_possible_cpu(cpu) {
+        const struct aesd_stats *stats = per_cpu_ptr(dev->stats, cpu);
+
+        total->bytes_written += stats->bytes_written;
+        total->records_written += stats->records_written;
+        total->entries_evicted += stats->entries_evicted;
+        total->lock_acquisitions += stats->lock_acquisitions;
+        total->lock_wait_ns += stats->lock_wait_ns;
+        total->lock_hold_ns += stats->lock_hold_ns;
+        for (i = 0; i < AESD_LATENCY_BUCKETS; i++) {
+            total->read_latency[i] += stats->read_latency[i];
+            total->write_latency[i] += stats->write_latency[i];
+        }
+    }
+}
+
+static int aesd_stats_show(struct seq_file *s, void *unused)
 {
-    int err, devno = MKDEV(aesd_major, aesd_minor);
+    struct aesd_dev *dev = s->private;
+    struct aesd_stats total;
+
+    aesd_sum_stats(dev, &total);
+    seq_printf(s, "bytes_written %llu\n", total.bytes_written);
+    seq_printf(s, "records_written %llu\n", total.records_written);
+    seq_printf(s, "entries_evicted %llu\n", total.entries_evicted);
+    seq_printf(s, "partial_bytes %zu\n", READ_ONCE(dev->write_buf_size));
+    seq_printf(s, "lock_acquisitions %llu\n", total.lock_acquisitions);
+    seq_printf(s, "lock_wait_ns %llu\n", total.lock_wait_ns);
+    seq_printf(s, "lock_hold_ns %llu\n", total.lock_hold_ns);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_stats);
+
+static int aesd_latency_show(struct seq_file *s, void *unused)
+{
+    struct aesd_dev *dev = s->private;
+    struct aesd_stats total;
+    unsigned int i;
+
+    aesd_sum_stats(dev, &total);
+    seq_puts(s, "max_ns read write\n");
+    for (i = 0; i < AESD_LATENCY_BUCKETS; i++) {
+        if (total.read_latency[i] == 0 && total.write_latency[i] == 0) {
+            continue;
+        }
+        if (i == AESD_LATENCY_BUCKETS - 1) {
+            // the last bucket has no upper bound, it also counts anything slower
+            seq_printf(s, ">=%llu %llu %llu\n", 1ULL << (i - 1),
+                    total.read_latency[i], total.write_latency[i]);
+        } else {
+            seq_printf(s, "%llu %llu %llu\n", (1ULL << i) - 1,
+                    total.read_latency[i], total.write_latency[i]);
+        }
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aesd_latency);
+
+/**
+ * Create the debugfs directory of @param dev, the device with index @param index.
+ * debugfs failures are not fatal, the driver works the same without the statistics files.
+ */
+static void aesd_debugfs_init(struct aesd_dev *dev, unsigned int index)
+{
+    char name[16];
+
+    snprintf(name, sizeof(name), "aesdchar%u", index);
+    dev->debugfs_dir = debugfs_create_dir(name, aesd_debugfs_root);
+    debugfs_create_file("stats", 0444, dev->debugfs_dir, dev, &aesd_stats_fops);
+    debugfs_create_file("latency", 0444, dev->debugfs_dir, dev, &aesd_latency_fops);
+}
+
+static int aesd_setup_cdev(struct aesd_dev *dev, unsigned int index)
+{
+    int err, devno = MKDEV(aesd_major, aesd_minor + index);
 
     cdev_init(&dev->cdev, &aesd_fops);
     dev->cdev.owner = THIS_MODULE;
     dev->cdev.ops = &aesd_fops;
     err = cdev_add (&dev->cdev, devno, 1);
     if (err) {
-        printk(KERN_ERR "Error %d adding aesd cdev", err);
+        printk(KERN_ERR "Error %d adding aesd cdev %u", err, index);
     }
     return err;
 }
 
+/**
+ * Remove the cdev for @param dev and free everything it still holds
+ */
+static void aesd_cleanup_device(struct aesd_dev *dev)
+{
+    struct aesd_buffer_entry *entry;
+    uint8_t idx;
 
+    debugfs_remove_recursive(dev->debugfs_dir);
+    cdev_del(&dev->cdev);
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, idx){
+        aesd_free_payload(dev, entry);
+    }
+    kvfree(dev->ring.data);
+    kfree(dev->write_buf);
+    free_percpu(dev->stats);
+}
 
 int aesd_init_module(void)
 {
     dev_t dev = 0;
     int result;
-    result = alloc_chrdev_region(&dev, aesd_minor, 1,
+    unsigned int i;
+    if (aesd_nr_devs == 0) {
+        printk(KERN_WARNING "aesd_nr_devs must be at least 1\n");
+        return -EINVAL;
+    }
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs,
             "aesdchar");
     aesd_major = MAJOR(dev);
     if (result < 0) {
         printk(KERN_WARNING "Can't get major %d\n", aesd_major);
         return result;
     }
-    memset(&aesd_device,0,sizeof(struct aesd_dev));
 
-    /**
-     * TODO: initialize the AESD specific portion of the device
-     */
-    aesd_circular_buffer_init(&aesd_device.buffer);
-    mutex_init(&aesd_device.lock); // initialize mutex lock
-    aesd_device.write_buf = NULL; 
-    aesd_device.write_buf_size =0;
-    result = aesd_setup_cdev(&aesd_device);
-    
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL);
+    if (!aesd_devices) {
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return -ENOMEM;
+    }
+
+    aesd_payload_cache = kmem_cache_create("aesd_payload", AESD_SMALL_PAYLOAD_SIZE, 0, 0, NULL);
+    if (!aesd_payload_cache) {
+        kfree(aesd_devices);
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return -ENOMEM;
+    }
+
+    aesd_debugfs_root = debugfs_create_dir("aesdchar", NULL);
+
+    for (i = 0; i < aesd_nr_devs; i++) {
+        struct aesd_dev *aesd_device = &aesd_devices[i];
+
+        aesd_circular_buffer_init(&aesd_device->buffer);
+        mutex_init(&aesd_device->lock); // initialize mutex lock
+        init_waitqueue_head(&aesd_device->read_queue);
+        aesd_device->write_buf = NULL;
+        aesd_device->write_buf_size = 0;
+        aesd_device->write_buf_capacity = 0;
+        aesd_device->stats = alloc_percpu(struct aesd_stats);
+        if (!aesd_device->stats) {
+            result = -ENOMEM;
+            break;
+        }
+        if (aesd_ring_bytes) {
+            // large rings fall back to vmalloc, the ring only needs to be virtually contiguous
+            char *ring = kvmalloc(aesd_ring_bytes, GFP_KERNEL);
+
+            if (!ring) {
+                free_percpu(aesd_device->stats);
+                result = -ENOMEM;
+                break;
+            }
+            aesd_byte_ring_init(&aesd_device->ring, ring, aesd_ring_bytes);
+        }
+        result = aesd_setup_cdev(aesd_device, i);
+        if( result ) {
+            kvfree(aesd_device->ring.data);
+            free_percpu(aesd_device->stats);
+            break;
+        }
+        aesd_debugfs_init(aesd_device, i);
+    }
+
     if( result ) {
-        unregister_chrdev_region(dev, 1);
+        while (i-- > 0) {
+            aesd_cleanup_device(&aesd_devices[i]);
+        }
+        debugfs_remove_recursive(aesd_debugfs_root);
+        kmem_cache_destroy(aesd_payload_cache);
+        kfree(aesd_devices);
+        unregister_chrdev_region(dev, aesd_nr_devs);
     }
     return result;
 
@@ -365,17 +1121,15 @@ int aesd_init_module(void)
 void aesd_cleanup_module(void)
 {
     dev_t devno = MKDEV(aesd_major, aesd_minor);
-    struct aesd_buffer_entry *entry;
-    int8_t idx;
-    cdev_del(&aesd_device.cdev);
+    unsigned int i;
 
-    /**
-     * TODO: cleanup AESD specific poritions here as necessary
-     */
-    AESD_CIRCULAR_BUFFER_FOREACH(entry, &aesd_device.buffer, idx){
-        kfree(entry->buffptr);
+    for (i = 0; i < aesd_nr_devs; i++) {
+        aesd_cleanup_device(&aesd_devices[i]);
     }
-    unregister_chrdev_region(devno, 1);
+    debugfs_remove_recursive(aesd_debugfs_root);
+    kmem_cache_destroy(aesd_payload_cache);
+    kfree(aesd_devices);
+    unregister_chrdev_region(devno, aesd_nr_devs);
 }
 
 
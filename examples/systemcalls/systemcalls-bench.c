@@ -0,0 +1,191 @@
+/**
+ * @file systemcalls-bench.c
+ * @brief Launch to exit latency of the systemcalls.c functions
+ *
+ * Usage: systemcalls-bench [iterations] [rss_mb ...]
+ * For each parent resident set size (default 0 64 256 1024 MB, touched so its pages are really
+ * mapped) runs each command type through do_system(), do_exec() and do_exec_redirect() with
+ * both exec backends, and do_exec_capture(), and prints latency percentiles in microseconds.
+ * Comparing do_system() with do_exec() shows the cost of the extra shell, comparing the fork
+ * and spawn backends as the RSS grows shows the cost of copying the page tables.
+ *
+ * @date 2026-10-19
+ */
+
+#include "systemcalls.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_ITERATIONS 200
+#define BENCH_OUTPUT_FILE "/tmp/systemcalls-bench.out"
+
+enum bench_method
+{
+    BENCH_SYSTEM,
+    BENCH_EXEC_SPAWN,
+    BENCH_EXEC_FORK,
+    BENCH_REDIRECT_SPAWN,
+    BENCH_REDIRECT_FORK,
+    BENCH_CAPTURE_SPAWN,
+    BENCH_METHODS,
+};
+
+static const char *bench_method_names[BENCH_METHODS] = {
+    "do_system", "do_exec spawn", "do_exec fork",
+    "do_exec_redirect spawn", "do_exec_redirect fork", "do_exec_capture spawn",
+};
+
+/**
+ * A command, as a shell string for do_system() and as arguments for the others
+ */
+struct bench_command
+{
+    const char *name;
+    const char *shell;
+    char *argv[4];
+    int argc;
+};
+
+static struct bench_command bench_commands[] = {
+    { "true", "/bin/true", { "/bin/true" }, 1 },
+    { "sleep 0", "/bin/sleep 0", { "/bin/sleep", "0" }, 2 },
+    { "sh -c", "/bin/sh -c :", { "/bin/sh", "-c", ":" }, 3 },
+};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool bench_run_once(enum bench_method method, struct bench_command *command)
+{
+    struct exec_output output = { NULL, 0, 0 };
+    char **argv = command->argv;
+    bool ok;
+
+    switch (method)
+    {
+        case BENCH_SYSTEM:
+            return do_system(command->shell);
+        case BENCH_EXEC_SPAWN:
+        case BENCH_EXEC_FORK:
+            set_exec_backend(method == BENCH_EXEC_FORK ? EXEC_BACKEND_FORK : EXEC_BACKEND_SPAWN);
+            return do_exec(command->argc, argv[0], argv[1], argv[2]);
+        case BENCH_REDIRECT_SPAWN:
+        case BENCH_REDIRECT_FORK:
+            set_exec_backend(method == BENCH_REDIRECT_FORK ? EXEC_BACKEND_FORK : EXEC_BACKEND_SPAWN);
+            return do_exec_redirect(BENCH_OUTPUT_FILE, command->argc, argv[0], argv[1], argv[2]);
+        case BENCH_CAPTURE_SPAWN:
+            set_exec_backend(EXEC_BACKEND_SPAWN);
+            ok = do_exec_capture(&output, NULL, command->argc, argv[0], argv[1], argv[2]);
+            exec_output_free(&output);
+            return ok;
+        default:
+            return false;
+    }
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double bench_percentile(const uint64_t *sorted, size_t count, double percentile)
+{
+    size_t index = (size_t)(percentile / 100.0 * (count - 1) + 0.5);
+
+    return sorted[index] / 1000.0;
+}
+
+/**
+ * Allocate @param mb megabytes and touch every page so it counts in the resident set
+ */
+static char *bench_grow_rss(size_t mb)
+{
+    size_t bytes = mb * 1024 * 1024;
+    char *memory;
+
+    if (bytes == 0)
+    {
+        return NULL;
+    }
+    memory = malloc(bytes);
+    if (!memory)
+    {
+        fprintf(stderr, "Could not allocate %zu MB\n", mb);
+        exit(1);
+    }
+    memset(memory, 1, bytes);
+    return memory;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t default_rss_mb[] = { 0, 64, 256, 1024 };
+    size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ITERATIONS;
+    size_t rss_count = argc > 2 ? (size_t)(argc - 2) : sizeof(default_rss_mb) / sizeof(default_rss_mb[0]);
+    uint64_t *samples;
+    size_t r;
+    size_t c;
+    size_t i;
+    int m;
+
+    if (iterations == 0)
+    {
+        fprintf(stderr, "Usage: %s [iterations] [rss_mb ...]\n", argv[0]);
+        return 1;
+    }
+    samples = calloc(iterations, sizeof(*samples));
+    if (!samples)
+    {
+        return 1;
+    }
+
+    printf("%7s %-8s %-24s %9s %9s %9s %9s %9s\n", "rss_mb", "command", "method",
+            "p50_us", "p90_us", "p99_us", "max_us", "failures");
+    fflush(stdout);
+    for (r = 0; r < rss_count; r++)
+    {
+        size_t rss_mb = argc > 2 ? strtoul(argv[2 + r], NULL, 0) : default_rss_mb[r];
+        char *ballast = bench_grow_rss(rss_mb);
+
+        for (c = 0; c < sizeof(bench_commands) / sizeof(bench_commands[0]); c++)
+        {
+            for (m = 0; m < BENCH_METHODS; m++)
+            {
+                size_t failures = 0;
+
+                for (i = 0; i < iterations; i++)
+                {
+                    uint64_t start = bench_now_ns();
+
+                    if (!bench_run_once(m, &bench_commands[c]))
+                    {
+                        failures++;
+                    }
+                    samples[i] = bench_now_ns() - start;
+                }
+                qsort(samples, iterations, sizeof(*samples), bench_compare);
+                printf("%7zu %-8s %-24s %9.1f %9.1f %9.1f %9.1f %9zu\n", rss_mb,
+                        bench_commands[c].name, bench_method_names[m],
+                        bench_percentile(samples, iterations, 50),
+                        bench_percentile(samples, iterations, 90),
+                        bench_percentile(samples, iterations, 99),
+                        samples[iterations - 1] / 1000.0, failures);
+                fflush(stdout);
+            }
+        }
+        free(ballast);
+    }
+    unlink(BENCH_OUTPUT_FILE);
+    free(samples);
+    return 0;
+}
@@ -1,8 +1,22 @@
+#define _GNU_SOURCE // pipe2()
 #include "systemcalls.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <spawn.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <stdlib.h>
+#include <string.h>
+
+extern char **environ;
+
+static enum exec_backend exec_backend = EXEC_BACKEND_SPAWN;
 
 
 /**
@@ -32,6 +46,352 @@ bool do_system(const char *cmd)
     return true;
 }
 
+/**
+* Select how do_exec() and do_exec_redirect() start the command, EXEC_BACKEND_SPAWN by default.
+* Not thread safe, call before starting commands from several threads.
+*/
+void set_exec_backend(enum exec_backend backend)
+{
+    exec_backend = backend;
+}
+
+/**
+* Wait for the child @param pid to terminate
+* @return true if it exited with status 0
+*/
+static bool wait_for_child(pid_t pid)
+{
+    int status = 0;
+    int ret;
+
+    do
+    {
+        ret = waitpid(pid, &status, 0);
+    } while(ret < 0 && errno == EINTR);
+
+    if(ret < 0)
+    {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+* Where the standard out and standard error of a child go, anything not set is inherited
+*/
+struct child_stdio
+{
+    const char *outputfile; // file opened with O_TRUNC as standard out, or NULL
+    int stdout_fd;          // descriptor duplicated to standard out, or -1
+    int stderr_fd;          // descriptor duplicated to standard error, or -1
+};
+
+/**
+* Start @param command with fork() and execv(), with standard out and standard error set up
+* as described by @param stdio.  fork() copies the page tables of the caller,
+* so the cost of each call grows with the memory footprint of the caller.
+* @return the pid of the child or -1 on failure
+*/
+static pid_t fork_command(char *const command[], const struct child_stdio *stdio)
+{
+    pid_t pid = fork();
+    int fd;
+
+    if(pid != 0)
+    {
+        return pid;
+    }
+
+    //child process, must never return into the copy of the caller
+    if(stdio->outputfile)
+    {
+        fd = open(stdio->outputfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        if(dup2(fd, STDOUT_FILENO) < 0)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+    if(stdio->stdout_fd >= 0 && dup2(stdio->stdout_fd, STDOUT_FILENO) < 0)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    if(stdio->stderr_fd >= 0 && dup2(stdio->stderr_fd, STDERR_FILENO) < 0)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    execv(command[0], command);
+    _exit(EXIT_FAILURE);
+}
+
+/**
+* Start @param command with posix_spawn(), with standard out and standard error set up as
+* described by @param stdio.  glibc implements posix_spawn() with clone(CLONE_VM | CLONE_VFORK),
+* the child shares the memory of the caller until it execs, so the cost does not depend on the
+* memory footprint of the caller, and a failure to open the file or to exec is reported here.
+* @return the pid of the child or -1 on failure
+*/
+static pid_t spawn_command(char *const command[], const struct child_stdio *stdio)
+{
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int err;
+
+    if(posix_spawn_file_actions_init(&actions) != 0)
+    {
+        return -1;
+    }
+    err = 0;
+    if(stdio->outputfile)
+    {
+        err = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, stdio->outputfile,
+                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if(!err && stdio->stdout_fd >= 0)
+    {
+        err = posix_spawn_file_actions_adddup2(&actions, stdio->stdout_fd, STDOUT_FILENO);
+    }
+    if(!err && stdio->stderr_fd >= 0)
+    {
+        err = posix_spawn_file_actions_adddup2(&actions, stdio->stderr_fd, STDERR_FILENO);
+    }
+    if(!err)
+    {
+        err = posix_spawn(&pid, command[0], &actions, NULL, command, environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    if(err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+/**
+* Start @param command with the selected backend
+* @return the pid of the child or -1 on failure
+*/
+static pid_t start_command(char *const command[], const struct child_stdio *stdio)
+{
+    if(exec_backend == EXEC_BACKEND_FORK)
+    {
+        return fork_command(command, stdio);
+    }
+    return spawn_command(command, stdio);
+}
+
+/**
+* Run @param command with the selected backend and wait for it
+* @return true if the command was started and exited with status 0
+*/
+static bool run_command(char *const command[], const char *outputfile)
+{
+    struct child_stdio stdio = { outputfile, -1, -1 };
+    pid_t pid = start_command(command, &stdio);
+
+    if(pid < 0)
+    {
+        return false;
+    }
+    return wait_for_child(pid);
+}
+
+/**
+* @return a pidfd referring to the child @param pid, or -1 when the kernel has no pidfd_open()
+*/
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+* @return true if the child @param pid has exited, without reaping it
+*/
+static bool child_exited(pid_t pid)
+{
+    siginfo_t info;
+
+    // WNOWAIT leaves the child to be reaped later with its exit status
+    info.si_pid = 0;
+    return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+* State of a command of a batch while it runs
+*/
+struct batch_slot
+{
+    size_t index;   // index of the command in the batch
+    pid_t pid;
+    int pidfd;      // -1 when pidfd_open() is not available
+    uint64_t start_ns;
+};
+
+/**
+* Reap the child of @param slot, which must have exited or be about to,
+* and store its results in @param command
+*/
+static void batch_reap(struct batch_slot *slot, struct exec_batch_command *command)
+{
+    int status = 0;
+    int ret;
+
+    do
+    {
+        ret = waitpid(slot->pid, &status, 0);
+    } while(ret < 0 && errno == EINTR);
+
+    command->wall_time_ns = monotonic_ns() - slot->start_ns;
+    command->status = status;
+    command->success = ret >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if(slot->pidfd >= 0)
+    {
+        close(slot->pidfd);
+    }
+}
+
+/**
+* Run the @param count commands in @param commands with at most @param max_concurrency of them
+* running at the same time, 0 for one per online CPU.  Commands are started in order and each
+* finished child is reaped as soon as it exits, by polling a pidfd per child, so a slow command
+* does not keep the others from starting.  A child whose pidfd could not be opened, or every
+* child without pidfd support, is checked every millisecond instead.
+* Only the children started here are reaped.
+* @return true if every command was started and exited with status 0, the outcome of each
+*   command is stored in its started, status, success and wall_time_ns members
+*/
+bool do_exec_batch(struct exec_batch_command *commands, size_t count, unsigned int max_concurrency)
+{
+    struct batch_slot *slots;
+    struct pollfd *pollfds;
+    size_t next = 0;
+    size_t running = 0;
+    size_t with_pidfd;
+    size_t i;
+    bool all_succeeded = true;
+
+    if(max_concurrency == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_concurrency = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    if(max_concurrency > count)
+    {
+        max_concurrency = count ? count : 1;
+    }
+    slots = calloc(max_concurrency, sizeof(*slots));
+    pollfds = calloc(max_concurrency, sizeof(*pollfds));
+    if(!slots || !pollfds)
+    {
+        free(slots);
+        free(pollfds);
+        return false;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        commands[i].started = false;
+        commands[i].success = false;
+        commands[i].status = 0;
+        commands[i].wall_time_ns = 0;
+    }
+
+    while(next < count || running > 0)
+    {
+        // fill the free slots
+        while(next < count && running < max_concurrency)
+        {
+            struct batch_slot *slot = &slots[running];
+            struct child_stdio stdio = { commands[next].outputfile, -1, -1 };
+
+            slot->index = next;
+            slot->start_ns = monotonic_ns();
+            slot->pid = start_command(commands[next].argv, &stdio);
+            next++;
+            if(slot->pid < 0)
+            {
+                all_succeeded = false;
+                continue;
+            }
+            commands[slot->index].started = true;
+            slot->pidfd = open_pidfd(slot->pid);
+            running++;
+        }
+        if(running == 0)
+        {
+            break;
+        }
+
+        // wait until at least one child exits
+        with_pidfd = 0;
+        for(i = 0; i < running; i++)
+        {
+            pollfds[i].fd = slots[i].pidfd;
+            pollfds[i].events = POLLIN;
+            pollfds[i].revents = 0;
+            if(slots[i].pidfd >= 0)
+            {
+                with_pidfd++;
+            }
+        }
+        // poll() skips negative fds, children without one are checked every millisecond
+        if(poll(pollfds, running, with_pidfd < running ? 1 : -1) < 0 && errno != EINTR)
+        {
+            pollfds[0].revents = POLLIN; // fall back to a blocking wait rather than spinning
+        }
+        for(i = 0; i < running && with_pidfd < running; i++)
+        {
+            if(slots[i].pidfd < 0 && child_exited(slots[i].pid))
+            {
+                pollfds[i].revents = POLLIN;
+            }
+        }
+
+        // reap the children which exited and compact the running slots
+        for(i = 0; i < running; )
+        {
+            if(pollfds[i].revents)
+            {
+                batch_reap(&slots[i], &commands[slots[i].index]);
+                if(!commands[slots[i].index].success)
+                {
+                    all_succeeded = false;
+                }
+                running--;
+                slots[i] = slots[running];
+                pollfds[i] = pollfds[running];
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    free(slots);
+    free(pollfds);
+    return all_succeeded;
+}
+
 /**
 * @param count -The numbers of variables passed to the function. The variables are command to execute.
 *   followed by arguments to pass to the command
@@ -41,8 +401,8 @@ bool do_system(const char *cmd)
 *   The first is always the full path to the command to execute with execv()
 *   The remaining arguments are a list of arguments to pass to the command in execv()
 * @return true if the command @param ... with arguments @param arguments were executed successfully
-*   using the execv() call, false if an error occurred, either in invocation of the
-*   fork, waitpid, or execv() command, or if a non-zero return value was returned
+*   using the selected exec backend, false if an error occurred, either in starting the command
+*   or in waiting for it, or if a non-zero return value was returned
 *   by the command issued in @param arguments with the specified arguments.
 */
 
@@ -57,63 +417,208 @@ bool do_exec(int count, ...)
         command[i] = va_arg(args, char *);
     }
     command[count] = NULL;
-    // this line is to avoid a compile warning before your implementation is complete
-    // and may be removed
-    command[count] = command[count];
+    va_end(args);
 
-/*
- * TODO:
- *   Execute a system command by calling fork, execv(),
- *   and wait instead of system (see LSP page 161).
- *   Use the command[0] as the full path to the command to execute
- *   (first argument to execv), and use the remaining arguments
- *   as second argument to the execv() command.
- *
+    return run_command(command, NULL);
+}
+
+/**
+* @param outputfile - The full path to the file to write with command output.
+*   This file will be closed at completion of the function call.
+* All other parameters, see do_exec above
 */
+bool do_exec_redirect(const char *outputfile, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
     va_end(args);
 
-    int pid = fork();
-    int status = 0;
-    
-    if(pid < 0)
+    return run_command(command, outputfile);
+}
+
+/**
+* Read from the pipes in @param fds until both reach end of file, passing each chunk to
+* @param callback.  Both pipes are polled together so a child filling one of them while
+* the other is being read cannot deadlock.  The pipes are closed on return.
+*/
+static void drain_output(int fds[2], exec_output_callback callback, void *context)
+{
+    static const enum exec_stream streams[2] = { EXEC_STREAM_STDOUT, EXEC_STREAM_STDERR };
+    struct pollfd pollfds[2];
+    char chunk[4096];
+    ssize_t len;
+    int i;
+
+    while(fds[0] >= 0 || fds[1] >= 0)
     {
-        return false;
+        for(i = 0; i < 2; i++)
+        {
+            pollfds[i].fd = fds[i];
+            pollfds[i].events = POLLIN;
+            pollfds[i].revents = 0;
+        }
+        if(poll(pollfds, 2, -1) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for(i = 0; i < 2; i++)
+        {
+            if(fds[i] < 0 || !pollfds[i].revents)
+            {
+                continue;
+            }
+            len = read(fds[i], chunk, sizeof(chunk));
+            if(len < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(len <= 0)
+            {
+                close(fds[i]);
+                fds[i] = -1;
+                continue;
+            }
+            if(callback)
+            {
+                callback(streams[i], chunk, len, context);
+            }
+        }
+    }
+    for(i = 0; i < 2; i++)
+    {
+        if(fds[i] >= 0)
+        {
+            close(fds[i]);
+        }
     }
+}
 
-    if(pid == 0)
-    {   
-        //child process
-        execv(command[0], command);
-        exit(EXIT_FAILURE);
+/**
+* Run @param command with its standard out and standard error connected to pipes,
+* passing everything it writes to @param callback, and wait for it
+* @return true if the command was started and exited with status 0
+*/
+static bool capture_command(char *const command[], exec_output_callback callback, void *context)
+{
+    int out_pipe[2];
+    int err_pipe[2];
+    int read_fds[2];
+    struct child_stdio stdio;
+    pid_t pid;
+
+    if(pipe2(out_pipe, O_CLOEXEC) < 0)
+    {
+        return false;
+    }
+    if(pipe2(err_pipe, O_CLOEXEC) < 0)
+    {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return false;
+    }
+    stdio.outputfile = NULL;
+    stdio.stdout_fd = out_pipe[1];
+    stdio.stderr_fd = err_pipe[1];
+    pid = start_command(command, &stdio);
 
+    // only the child may hold the write ends, or the pipes never reach end of file
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    read_fds[0] = out_pipe[0];
+    read_fds[1] = err_pipe[0];
+    if(pid < 0)
+    {
+        close(read_fds[0]);
+        close(read_fds[1]);
         return false;
     }
-    
-    
-        //parent process
+    drain_output(read_fds, callback, context);
+    return wait_for_child(pid);
+}
 
-        //wait(&status);
-        int ret = waitpid(pid, &status, 0);
+/**
+* Append @param len bytes at @param data to @param output, growing it geometrically
+* @return false if memory could not be allocated
+*/
+static bool output_append(struct exec_output *output, const char *data, size_t len)
+{
+    if(output->size + len + 1 > output->capacity)
+    {
+        size_t capacity = output->capacity ? output->capacity * 2 : 4096;
+        char *grown;
 
-        if(ret < 0)
+        while(capacity < output->size + len + 1)
+        {
+            capacity *= 2;
+        }
+        grown = realloc(output->data, capacity);
+        if(!grown)
         {
             return false;
         }
-    
-        
-    
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->size, data, len);
+    output->size += len;
+    output->data[output->size] = '\0';
+    return true;
+}
+
+/**
+* Destination buffers of do_exec_capture()
+*/
+struct capture_context
+{
+    struct exec_output *outputs[2]; // standard out and standard error, either may be NULL
+    bool failed;                    // set when a buffer could not grow
+};
 
+static void capture_to_buffers(enum exec_stream stream, const char *data, size_t len, void *context)
+{
+    struct capture_context *capture = context;
+    struct exec_output *output = capture->outputs[stream == EXEC_STREAM_STDERR];
 
-    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if(output && !output_append(output, data, len))
+    {
+        capture->failed = true;
+    }
 }
 
 /**
-* @param outputfile - The full path to the file to write with command output.
-*   This file will be closed at completion of the function call.
+* Release the memory held by @param output and reset it to empty
+*/
+void exec_output_free(struct exec_output *output)
+{
+    free(output->data);
+    output->data = NULL;
+    output->size = 0;
+    output->capacity = 0;
+}
+
+/**
+* Run a command as do_exec() does, capturing what it writes in memory instead of a file.
+* @param out - Buffer receiving standard out, NULL to discard it.  Must be zero initialized or
+*   hold earlier output, which is appended to.  data is NUL terminated once anything was stored
+*   and must be released with exec_output_free().
+* @param err - Buffer receiving standard error in the same way, NULL to discard it
 * All other parameters, see do_exec above
+* @return true if the command exited with status 0 and all of its output was stored
 */
-bool do_exec_redirect(const char *outputfile, int count, ...)
+bool do_exec_capture(struct exec_output *out, struct exec_output *err, int count, ...)
 {
+    struct capture_context capture = { { out, err }, false };
     va_list args;
     va_start(args, count);
     char * command[count+1];
@@ -123,65 +628,165 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
         command[i] = va_arg(args, char *);
     }
     command[count] = NULL;
-    // this line is to avoid a compile warning before your implementation is complete
-    // and may be removed
-    command[count] = command[count];
+    va_end(args);
 
+    return capture_command(command, capture_to_buffers, &capture) && !capture.failed;
+}
 
-/*
- * TODO
- *   Call execv, but first using https://stackoverflow.com/a/13784315/1446624 as a refernce,
- *   redirect standard out to a file specified by outputfile.
- *   The rest of the behaviour is same as do_exec()
- *
+/**
+* Run a command as do_exec() does, passing what it writes to standard out and standard error
+* to @param callback as it arrives, with @param context, without buffering the whole output.
+* All other parameters, see do_exec above
 */
-    int status = 0;
-    int dup2_status = 0;
-    int fd = 0;
+bool do_exec_stream(exec_output_callback callback, void *context, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+    va_end(args);
 
-    int pid = fork();
+    return capture_command(command, callback, context);
+}
 
-    if(pid == 0)
-    {
-        //child process
-        fd = open(outputfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if(fd < 0)return false;
+/**
+* @return @param ms as a poll() timeout, clamped to INT_MAX
+*/
+static int poll_timeout_ms(uint64_t ms)
+{
+    return ms > INT_MAX ? INT_MAX : (int)ms;
+}
 
-        dup2_status = dup2(fd, STDOUT_FILENO);
-        close(fd);
+/**
+* Wait up to @param timeout_ms for the child @param pid to exit, without reaping it,
+* polling @param pidfd or, without pidfd support, checking every millisecond.
+* Timeouts beyond INT_MAX milliseconds are waited for in several polls.
+* @return true if the child exited
+*/
+static bool wait_for_exit(pid_t pid, int pidfd, unsigned int timeout_ms)
+{
+    uint64_t deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000ull;
+    struct pollfd pollfd;
+    int remaining_ms = poll_timeout_ms(timeout_ms);
+    uint64_t now;
+    int ret;
 
-        if(dup2_status < 0)
+    for(;;)
+    {
+        if(pidfd >= 0)
+        {
+            pollfd.fd = pidfd;
+            pollfd.events = POLLIN;
+            ret = poll(&pollfd, 1, remaining_ms);
+            if(ret > 0)
+            {
+                return true;
+            }
+            if(ret < 0 && errno != EINTR)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if(child_exited(pid))
+            {
+                return true;
+            }
+            usleep(1000);
+        }
+        now = monotonic_ns();
+        if(now >= deadline)
         {
             return false;
         }
+        remaining_ms = poll_timeout_ms((deadline - now + 999999) / 1000000);
+    }
+}
 
-        //child process
-        execv(command[0], command);
+/**
+* Run a command as do_exec() does, under supervision.  When the command is still running after
+* supervision->timeout_ms it is sent SIGTERM, and SIGKILL if it is still running
+* supervision->kill_grace_ms later.  The child is reaped with wait4() so its resource usage
+* can be reported.
+* @param supervision - timeout_ms and kill_grace_ms set by the caller, the other members
+*   are filled in with the outcome of the command
+* All other parameters, see do_exec above
+* @return true if the command finished within the timeout and exited with status 0
+*/
+bool do_exec_supervised(struct exec_supervision *supervision, int count, ...)
+{
+    struct child_stdio stdio = { NULL, -1, -1 };
+    struct rusage usage;
+    uint64_t start_ns;
+    pid_t pid;
+    int pidfd;
+    int status = 0;
+    int ret;
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+    va_end(args);
 
+    supervision->started = false;
+    supervision->timed_out = false;
+    supervision->killed = false;
+    supervision->status = 0;
+    supervision->wall_time_ns = 0;
+    memset(&supervision->user_time, 0, sizeof(supervision->user_time));
+    memset(&supervision->system_time, 0, sizeof(supervision->system_time));
+    supervision->max_rss_kb = 0;
 
-        
+    start_ns = monotonic_ns();
+    pid = start_command(command, &stdio);
+    if(pid < 0)
+    {
         return false;
     }
-    
-    {
-        //parent process
-        //wait(&status);
-        int ret = waitpid(pid, &status, 0);
+    supervision->started = true;
+    pidfd = open_pidfd(pid);
 
-        if(ret < 0)
+    if(supervision->timeout_ms &&
+            !wait_for_exit(pid, pidfd, supervision->timeout_ms))
+    {
+        // the child is not reaped yet, so its pid cannot have been reused
+        supervision->timed_out = true;
+        kill(pid, SIGTERM);
+        if(!wait_for_exit(pid, pidfd, supervision->kill_grace_ms))
         {
-            return false;
-        }
-
-        if(status == 0)
-        {
-            return true;
-        }else{
-            return false;
+            supervision->killed = true;
+            kill(pid, SIGKILL);
         }
     }
 
-    va_end(args);
+    do
+    {
+        ret = wait4(pid, &status, 0, &usage);
+    } while(ret < 0 && errno == EINTR);
+    supervision->wall_time_ns = monotonic_ns() - start_ns;
+    if(pidfd >= 0)
+    {
+        close(pidfd);
+    }
+    if(ret < 0)
+    {
+        return false;
+    }
 
-    return false;
+    supervision->status = status;
+    supervision->user_time = usage.ru_utime;
+    supervision->system_time = usage.ru_stime;
+    supervision->max_rss_kb = usage.ru_maxrss;
+    return !supervision->timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
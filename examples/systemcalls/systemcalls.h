@@ -1,9 +1,87 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+/**
+ * How do_exec() and do_exec_redirect() start the command
+ */
+enum exec_backend
+{
+    EXEC_BACKEND_SPAWN, // posix_spawn(), cost independent of the caller's memory footprint
+    EXEC_BACKEND_FORK,  // fork() and execv()
+};
+
+void set_exec_backend(enum exec_backend backend);
 
 bool do_system(const char *command);
 
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * Output stream of a command passed to an exec_output_callback
+ */
+enum exec_stream
+{
+    EXEC_STREAM_STDOUT,
+    EXEC_STREAM_STDERR,
+};
+
+/**
+ * Called by do_exec_stream() with each chunk of output of the command as it is read
+ */
+typedef void (*exec_output_callback)(enum exec_stream stream, const char *data, size_t len, void *context);
+
+/**
+ * Growable buffer filled by do_exec_capture()
+ */
+struct exec_output
+{
+    char *data;      // NUL terminated output, NULL until something is stored
+    size_t size;     // bytes of output in data, not counting the NUL
+    size_t capacity; // bytes allocated for data
+};
+
+bool do_exec_capture(struct exec_output *out, struct exec_output *err, int count, ...);
+
+bool do_exec_stream(exec_output_callback callback, void *context, int count, ...);
+
+void exec_output_free(struct exec_output *output);
+
+/**
+ * A command run by do_exec_batch()
+ */
+struct exec_batch_command
+{
+    char **argv;            // NULL terminated arguments, argv[0] is the full path of the command
+    const char *outputfile; // file to redirect standard out to as in do_exec_redirect(), or NULL
+    bool started;           // set when the command could be started
+    bool success;           // set when the command exited with status 0
+    int status;             // wait status of the command, see waitpid(), valid when started
+    uint64_t wall_time_ns;  // time from starting the command until it was reaped
+};
+
+bool do_exec_batch(struct exec_batch_command *commands, size_t count, unsigned int max_concurrency);
+
+/**
+ * Limits and outcome of a command run by do_exec_supervised()
+ */
+struct exec_supervision
+{
+    unsigned int timeout_ms;    // send SIGTERM when the command runs longer, 0 for no limit
+    unsigned int kill_grace_ms; // send SIGKILL when the command runs this long after SIGTERM
+    bool started;               // set when the command could be started
+    bool timed_out;             // set when the command was still running at timeout_ms
+    bool killed;                // set when SIGKILL was needed
+    int status;                 // wait status of the command, see waitpid()
+    uint64_t wall_time_ns;      // time from starting the command until it was reaped
+    struct timeval user_time;   // CPU time spent by the command in user mode
+    struct timeval system_time; // CPU time spent by the command in the kernel
+    long max_rss_kb;            // peak resident set size of the command in kilobytes
+};
+
+bool do_exec_supervised(struct exec_supervision *supervision, int count, ...);
@@ -0,0 +1,183 @@
+/**
+ * @file adaptivelock-bench.c
+ * @brief Throughput and fairness of adaptivelock compared with pthread mutexes
+ *
+ * Usage: adaptivelock-bench [duration_ms] [threads ...]
+ * For each thread count (default 1 2 4 8) every lock is hammered for duration_ms by threads
+ * which append a small record to a shared buffer under the lock, like aesdsocket writing a
+ * packet, then do a little work of their own.  Prints the acquisitions per second and the
+ * ratio between the least and the most served thread, 1.0 being perfectly fair.
+ *
+ * @date 2026-10-19
+ */
+
+#define _GNU_SOURCE // PTHREAD_MUTEX_ADAPTIVE_NP
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "adaptivelock.h"
+
+#define BENCH_DEFAULT_DURATION_MS 500
+#define BENCH_MAX_THREADS 256
+#define BENCH_RECORD_SIZE 64
+#define BENCH_BUFFER_SIZE 4096
+#define BENCH_OUTSIDE_WORK 200
+
+enum bench_lock
+{
+    BENCH_PTHREAD_DEFAULT,
+    BENCH_PTHREAD_ADAPTIVE,
+    BENCH_ADAPTIVELOCK,
+    BENCH_LOCKS,
+};
+
+static const char *bench_lock_names[BENCH_LOCKS] = {
+    "pthread default", "pthread adaptive_np", "adaptivelock",
+};
+
+static enum bench_lock bench_lock;
+static pthread_mutex_t bench_mutex;
+static struct adaptivelock bench_adaptivelock;
+static char bench_buffer[BENCH_BUFFER_SIZE];
+static size_t bench_buffer_used;
+static atomic_bool bench_stop;
+
+struct bench_thread
+{
+    pthread_t thread;
+    uint64_t acquisitions;
+};
+
+static void bench_lock_take(void)
+{
+    if (bench_lock == BENCH_ADAPTIVELOCK)
+    {
+        adaptivelock_lock(&bench_adaptivelock);
+    }
+    else
+    {
+        pthread_mutex_lock(&bench_mutex);
+    }
+}
+
+static void bench_lock_release(void)
+{
+    if (bench_lock == BENCH_ADAPTIVELOCK)
+    {
+        adaptivelock_unlock(&bench_adaptivelock);
+    }
+    else
+    {
+        pthread_mutex_unlock(&bench_mutex);
+    }
+}
+
+static void *bench_worker(void *arg)
+{
+    struct bench_thread *self = arg;
+    char record[BENCH_RECORD_SIZE];
+    volatile uint64_t work = 0;
+    int i;
+
+    memset(record, 'a', sizeof(record));
+    while (!atomic_load_explicit(&bench_stop, memory_order_relaxed))
+    {
+        bench_lock_take();
+        if (bench_buffer_used + sizeof(record) > sizeof(bench_buffer))
+        {
+            bench_buffer_used = 0;
+        }
+        memcpy(bench_buffer + bench_buffer_used, record, sizeof(record));
+        bench_buffer_used += sizeof(record);
+        bench_lock_release();
+        self->acquisitions++;
+
+        for (i = 0; i < BENCH_OUTSIDE_WORK; i++)
+        {
+            work += i;
+        }
+    }
+    return NULL;
+}
+
+static void bench_run(enum bench_lock lock, int nr_threads, unsigned int duration_ms)
+{
+    static struct bench_thread threads[BENCH_MAX_THREADS];
+    pthread_mutexattr_t attr;
+    struct timespec duration = { duration_ms / 1000, (duration_ms % 1000) * 1000000L };
+    uint64_t total = 0;
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    int i;
+
+    bench_lock = lock;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, lock == BENCH_PTHREAD_ADAPTIVE ? PTHREAD_MUTEX_ADAPTIVE_NP : PTHREAD_MUTEX_DEFAULT);
+    pthread_mutex_init(&bench_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    adaptivelock_init(&bench_adaptivelock);
+    bench_buffer_used = 0;
+    atomic_store(&bench_stop, false);
+
+    for (i = 0; i < nr_threads; i++)
+    {
+        threads[i].acquisitions = 0;
+        if (pthread_create(&threads[i].thread, NULL, bench_worker, &threads[i]) != 0)
+        {
+            fprintf(stderr, "Could not create thread %d\n", i);
+            exit(1);
+        }
+    }
+    nanosleep(&duration, NULL);
+    atomic_store(&bench_stop, true);
+    for (i = 0; i < nr_threads; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+        total += threads[i].acquisitions;
+        min = threads[i].acquisitions < min ? threads[i].acquisitions : min;
+        max = threads[i].acquisitions > max ? threads[i].acquisitions : max;
+    }
+    pthread_mutex_destroy(&bench_mutex);
+
+    printf("%7d %-20s %14.0f %9.2f\n", nr_threads, bench_lock_names[lock],
+            total * 1000.0 / duration_ms, max ? (double)min / max : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int default_threads[] = { 1, 2, 4, 8 };
+    unsigned int duration_ms = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_DURATION_MS;
+    int nr_counts = argc > 2 ? argc - 2 : (int)(sizeof(default_threads) / sizeof(default_threads[0]));
+    int c;
+    int l;
+
+    if (duration_ms == 0)
+    {
+        fprintf(stderr, "Usage: %s [duration_ms] [threads ...]\n", argv[0]);
+        return 1;
+    }
+    printf("%ld CPUs online\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%7s %-20s %14s %9s\n", "threads", "lock", "acquisitions/s", "fairness");
+    for (c = 0; c < nr_counts; c++)
+    {
+        int nr_threads = argc > 2 ? atoi(argv[2 + c]) : default_threads[c];
+
+        if (nr_threads < 1 || nr_threads > BENCH_MAX_THREADS)
+        {
+            fprintf(stderr, "Thread counts must be between 1 and %d\n", BENCH_MAX_THREADS);
+            return 1;
+        }
+        for (l = 0; l < BENCH_LOCKS; l++)
+        {
+            bench_run(l, nr_threads, duration_ms);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "adaptivelock.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static _Atomic int adaptivelock_spin_allowed = -1;
+
+static inline void adaptivelock_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static void adaptivelock_futex_wait(_Atomic uint32_t *word, uint32_t expected)
+{
+    // EAGAIN when the word changed before sleeping and EINTR are both handled by rechecking
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void adaptivelock_futex_wake(_Atomic uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @return true if spinning can help, which needs another CPU to run the holder meanwhile
+ */
+static bool adaptivelock_can_spin(void)
+{
+    int allowed = atomic_load_explicit(&adaptivelock_spin_allowed, memory_order_relaxed);
+
+    if(allowed < 0)
+    {
+        allowed = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+        atomic_store_explicit(&adaptivelock_spin_allowed, allowed, memory_order_relaxed);
+    }
+    return allowed;
+}
+
+void adaptivelock_init(struct adaptivelock *lock)
+{
+    memset(lock, 0, sizeof(*lock));
+}
+
+int adaptivelock_lock(struct adaptivelock *lock)
+{
+    uint32_t ticket = atomic_fetch_add_explicit(&lock->next_ticket, 1, memory_order_relaxed);
+    struct adaptivelock_slot *slot = &lock->slots[ticket % ADAPTIVELOCK_SLOTS];
+    uint32_t turn;
+
+    if(atomic_load_explicit(&slot->turn, memory_order_acquire) == ticket)
+    {
+        atomic_store_explicit(&lock->owner_ticket, ticket, memory_order_relaxed);
+        return 0;
+    }
+
+    if(adaptivelock_can_spin() &&
+            ticket - atomic_load_explicit(&lock->owner_ticket, memory_order_relaxed) <= ADAPTIVELOCK_SPIN_DISTANCE)
+    {
+        uint32_t estimate = atomic_load_explicit(&lock->spin_estimate, memory_order_relaxed);
+        uint32_t limit = estimate * 2 + 10;
+        uint32_t spins;
+
+        if(limit > ADAPTIVELOCK_MAX_SPIN)
+        {
+            limit = ADAPTIVELOCK_MAX_SPIN;
+        }
+        for(spins = 0; spins < limit; spins++)
+        {
+            adaptivelock_pause();
+            if(atomic_load_explicit(&slot->turn, memory_order_acquire) == ticket)
+            {
+                // racing updates of the estimate only lose some precision
+                atomic_store_explicit(&lock->spin_estimate, estimate + ((int32_t)(spins - estimate) / 8),
+                        memory_order_relaxed);
+                atomic_store_explicit(&lock->owner_ticket, ticket, memory_order_relaxed);
+                return 0;
+            }
+        }
+        // spinning did not pay off, spin less next time
+        atomic_store_explicit(&lock->spin_estimate, estimate - estimate / 8, memory_order_relaxed);
+    }
+
+    // pairs with the parked check in adaptivelock_unlock(), one of the two sides sees the other
+    atomic_fetch_add(&slot->parked, 1);
+    while((turn = atomic_load(&slot->turn)) != ticket)
+    {
+        adaptivelock_futex_wait(&slot->turn, turn);
+    }
+    atomic_fetch_sub_explicit(&slot->parked, 1, memory_order_relaxed);
+    atomic_store_explicit(&lock->owner_ticket, ticket, memory_order_relaxed);
+    return 0;
+}
+
+int adaptivelock_trylock(struct adaptivelock *lock)
+{
+    uint32_t ticket = atomic_load_explicit(&lock->next_ticket, memory_order_relaxed);
+    struct adaptivelock_slot *slot = &lock->slots[ticket % ADAPTIVELOCK_SLOTS];
+
+    // the lock is free only when the next ticket to be issued is also the one being served
+    if(atomic_load_explicit(&slot->turn, memory_order_acquire) != ticket ||
+            !atomic_compare_exchange_strong_explicit(&lock->next_ticket, &ticket, ticket + 1,
+                    memory_order_acquire, memory_order_relaxed))
+    {
+        return EBUSY;
+    }
+    atomic_store_explicit(&lock->owner_ticket, ticket, memory_order_relaxed);
+    return 0;
+}
+
+int adaptivelock_unlock(struct adaptivelock *lock)
+{
+    uint32_t next = atomic_load_explicit(&lock->owner_ticket, memory_order_relaxed) + 1;
+    struct adaptivelock_slot *slot = &lock->slots[next % ADAPTIVELOCK_SLOTS];
+
+    atomic_store(&slot->turn, next);
+    if(atomic_load(&slot->parked))
+    {
+        // also wakes sleepers of later tickets sharing the slot, which go back to sleep
+        adaptivelock_futex_wake(&slot->turn);
+    }
+    return 0;
+}
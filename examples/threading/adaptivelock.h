@@ -0,0 +1,71 @@
+#ifndef ADAPTIVELOCK_H
+#define ADAPTIVELOCK_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * A lock for short critical sections, built on futex.
+ * Lockers take a ticket and are served in ticket order, so a thread unlocking and locking again
+ * cannot starve the others.  A waiter next in line spins for a while, pausing the CPU between
+ * checks, since the holder of a short critical section is likely to release it soon; a waiter
+ * further back, or one which spun for too long, sleeps on the futex of its slot.  Unlocking
+ * hands the lock to the next ticket and wakes only the sleepers of that ticket's slot.
+ * Spinning is disabled on a single CPU, where it could only delay the holder.
+ *
+ * Build with ADAPTIVELOCK defined to use it instead of pthread mutexes in aesdsocket and
+ * in the thread pool, see lockprof_mutex_lock().
+ */
+
+// Waiters which can each sleep on a futex of their own, tickets further apart share one
+#define ADAPTIVELOCK_SLOTS 16
+
+// Most pause iterations a waiter spins before sleeping
+#define ADAPTIVELOCK_MAX_SPIN 1000
+
+// Waiters more than this many tickets behind the holder sleep without spinning
+#define ADAPTIVELOCK_SPIN_DISTANCE 2
+
+/**
+ * turn holds the ticket allowed to take the lock next among the tickets of this slot,
+ * parked the number of waiters sleeping on it.  Each slot has its own cache line.
+ */
+struct adaptivelock_slot
+{
+    alignas(64) _Atomic uint32_t turn;
+    _Atomic uint32_t parked;
+};
+
+struct adaptivelock
+{
+    alignas(64) _Atomic uint32_t next_ticket;
+    _Atomic uint32_t owner_ticket;  // written by the holder, read by waiters to decide to spin
+    _Atomic uint32_t spin_estimate; // moving average of the spins a successful waiter needed
+    struct adaptivelock_slot slots[ADAPTIVELOCK_SLOTS];
+};
+
+// Ticket 0 may take the lock since only slots[0].turn matches its ticket
+#define ADAPTIVELOCK_INITIALIZER { 0 }
+
+void adaptivelock_init(struct adaptivelock *lock);
+
+/**
+* Take @param lock, waiting for the holders of earlier tickets.
+* @return 0, for use in place of pthread_mutex_lock()
+*/
+int adaptivelock_lock(struct adaptivelock *lock);
+
+/**
+* Take @param lock if it is free and nobody is waiting for it.
+* @return 0 if it was taken, EBUSY otherwise
+*/
+int adaptivelock_trylock(struct adaptivelock *lock);
+
+/**
+* Hand @param lock to the next waiter, must be called by its holder.
+* @return 0, for use in place of pthread_mutex_unlock()
+*/
+int adaptivelock_unlock(struct adaptivelock *lock);
+
+#endif
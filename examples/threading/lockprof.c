@@ -0,0 +1,537 @@
+#include "lockprof.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Call sites listed for each mutex by lockprof_dump()
+#define LOCKPROF_TOP_SITES 5
+
+/**
+ * A call site which had to wait for a mutex.  file and line are written once, before contended
+ * is first published, by the holder of the mutex.
+ */
+struct lockprof_site
+{
+    const char *file;
+    int line;
+    _Atomic uint64_t contended;
+    _Atomic uint64_t wait_ns;
+};
+
+/**
+ * Statistics of one mutex.  mutex is set while the slot is claimed, everything else is only
+ * written by the holder of the mutex, or while nobody can hold it by lockprof_release_slot().
+ * The atomics are there so lockprof_dump() can read them at any time.
+ */
+struct lockprof_stats
+{
+    _Atomic(const void *) mutex;
+    _Atomic(const char *) name;
+    _Atomic uint64_t acquisitions;
+    _Atomic uint64_t contended;
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t hold_ns;
+    _Atomic uint64_t max_wait_ns;
+    _Atomic uint64_t max_hold_ns;
+    _Atomic uint64_t wait_histogram[LOCKPROF_HISTOGRAM_BUCKETS]; // contended acquisitions only
+    _Atomic uint64_t hold_histogram[LOCKPROF_HISTOGRAM_BUCKETS];
+    _Atomic uint64_t sites_dropped; // contended acquisitions from sites which found no free slot
+    struct lockprof_site sites[LOCKPROF_MAX_SITES];
+    uint64_t acquired_ns;
+};
+
+static struct lockprof_stats lockprof_table[LOCKPROF_MAX_MUTEXES];
+static _Atomic uint64_t lockprof_untracked;
+static pthread_once_t lockprof_once = PTHREAD_ONCE_INIT;
+
+static uint64_t lockprof_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Add @param value to @param counter, which is only ever written by one thread at a time
+ */
+static inline void lockprof_add(_Atomic uint64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+            memory_order_relaxed);
+}
+
+static inline void lockprof_max(_Atomic uint64_t *counter, uint64_t value)
+{
+    if(value > atomic_load_explicit(counter, memory_order_relaxed))
+    {
+        atomic_store_explicit(counter, value, memory_order_relaxed);
+    }
+}
+
+static inline unsigned int lockprof_bucket(uint64_t ns)
+{
+    unsigned int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+
+    return bucket < LOCKPROF_HISTOGRAM_BUCKETS ? bucket : LOCKPROF_HISTOGRAM_BUCKETS - 1;
+}
+
+static void lockprof_report(void)
+{
+    const char *path = getenv("LOCKPROF_OUTPUT");
+    FILE *out = path ? fopen(path, "a") : NULL;
+
+    lockprof_dump(out ? out : stderr);
+    if(out)
+    {
+        fclose(out);
+    }
+}
+
+static void lockprof_register_report(void)
+{
+    atexit(lockprof_report);
+}
+
+/**
+ * Zero the statistics in @param stats
+ */
+static void lockprof_clear(struct lockprof_stats *stats)
+{
+    size_t j;
+
+    atomic_store(&stats->acquisitions, 0);
+    atomic_store(&stats->contended, 0);
+    atomic_store(&stats->wait_ns, 0);
+    atomic_store(&stats->hold_ns, 0);
+    atomic_store(&stats->max_wait_ns, 0);
+    atomic_store(&stats->max_hold_ns, 0);
+    atomic_store(&stats->sites_dropped, 0);
+    for(j = 0; j < LOCKPROF_HISTOGRAM_BUCKETS; j++)
+    {
+        atomic_store(&stats->wait_histogram[j], 0);
+        atomic_store(&stats->hold_histogram[j], 0);
+    }
+    for(j = 0; j < LOCKPROF_MAX_SITES; j++)
+    {
+        atomic_store(&stats->sites[j].contended, 0);
+        atomic_store(&stats->sites[j].wait_ns, 0);
+    }
+}
+
+/**
+ * Claim a free statistics slot for the mutex at @param mutex and store it in @param slot,
+ * unless another thread stored one first.  Only called when @param slot is 0, so the slots are
+ * searched once per mutex and never by a lock.
+ * @return the value of @param slot afterwards
+ */
+static int lockprof_claim_slot(_Atomic int *slot, const void *mutex)
+{
+    int claimed = -1;
+    int expected = 0;
+    size_t i;
+
+    for(i = 0; i < LOCKPROF_MAX_MUTEXES; i++)
+    {
+        const void *key = NULL;
+
+        if(atomic_compare_exchange_strong(&lockprof_table[i].mutex, &key, mutex))
+        {
+            claimed = i + 1;
+            break;
+        }
+    }
+    if(!atomic_compare_exchange_strong(slot, &expected, claimed))
+    {
+        // expected holds the slot stored by the other thread
+        if(claimed > 0)
+        {
+            atomic_store_explicit(&lockprof_table[claimed - 1].mutex, NULL, memory_order_release);
+        }
+        return expected;
+    }
+    if(claimed > 0)
+    {
+        pthread_once(&lockprof_once, lockprof_register_report);
+    }
+    return claimed;
+}
+
+/**
+ * Give back the statistics slot stored in @param slot, which no thread may be locking
+ */
+static void lockprof_release_slot(_Atomic int *slot)
+{
+    int index = atomic_exchange(slot, 0);
+
+    if(index > 0)
+    {
+        struct lockprof_stats *stats = &lockprof_table[index - 1];
+
+        lockprof_clear(stats);
+        atomic_store_explicit(&stats->name, NULL, memory_order_relaxed);
+        stats->acquired_ns = 0;
+        // publishes the cleared statistics to the next claim
+        atomic_store_explicit(&stats->mutex, NULL, memory_order_release);
+    }
+}
+
+/**
+ * @return the statistics of the mutex at @param mutex whose slot is @param slot,
+ * claiming a slot on its first use, or NULL when the profiler is full
+ */
+static inline struct lockprof_stats *lockprof_stats_of(_Atomic int *slot, const void *mutex)
+{
+    int index = atomic_load_explicit(slot, memory_order_acquire);
+
+    if(index == 0)
+    {
+        index = lockprof_claim_slot(slot, mutex);
+    }
+    return index > 0 ? &lockprof_table[index - 1] : NULL;
+}
+
+/**
+ * Charge a contended acquisition which waited @param wait_ns to @param file and @param line
+ */
+static void lockprof_record_site(struct lockprof_stats *stats, const char *file, int line, uint64_t wait_ns)
+{
+    size_t i;
+
+    for(i = 0; i < LOCKPROF_MAX_SITES; i++)
+    {
+        struct lockprof_site *site = &stats->sites[i];
+
+        if(atomic_load_explicit(&site->contended, memory_order_relaxed) == 0)
+        {
+            site->file = file;
+            site->line = line;
+            atomic_store_explicit(&site->wait_ns, wait_ns, memory_order_relaxed);
+            // publishes file and line to lockprof_dump()
+            atomic_store_explicit(&site->contended, 1, memory_order_release);
+            return;
+        }
+        if(site->line == line && (site->file == file || strcmp(site->file, file) == 0))
+        {
+            lockprof_add(&site->contended, 1);
+            lockprof_add(&site->wait_ns, wait_ns);
+            return;
+        }
+    }
+    lockprof_add(&stats->sites_dropped, 1);
+}
+
+/**
+ * Operations of one type of lock, so both can share the bookkeeping below
+ */
+struct lockprof_ops
+{
+    int (*trylock)(void *mutex);
+    int (*lock)(void *mutex);
+    int (*unlock)(void *mutex);
+};
+
+static int lockprof_ops_pthread_trylock(void *mutex)
+{
+    return pthread_mutex_trylock(mutex);
+}
+
+static int lockprof_ops_pthread_lock(void *mutex)
+{
+    return pthread_mutex_lock(mutex);
+}
+
+static int lockprof_ops_pthread_unlock(void *mutex)
+{
+    return pthread_mutex_unlock(mutex);
+}
+
+static int lockprof_ops_adaptivelock_trylock(void *mutex)
+{
+    return adaptivelock_trylock(mutex);
+}
+
+static int lockprof_ops_adaptivelock_lock(void *mutex)
+{
+    return adaptivelock_lock(mutex);
+}
+
+static int lockprof_ops_adaptivelock_unlock(void *mutex)
+{
+    return adaptivelock_unlock(mutex);
+}
+
+static const struct lockprof_ops lockprof_pthread_ops = {
+    lockprof_ops_pthread_trylock, lockprof_ops_pthread_lock, lockprof_ops_pthread_unlock,
+};
+
+static const struct lockprof_ops lockprof_adaptivelock_ops = {
+    lockprof_ops_adaptivelock_trylock, lockprof_ops_adaptivelock_lock, lockprof_ops_adaptivelock_unlock,
+};
+
+static int lockprof_acquire(void *mutex, _Atomic int *slot, const struct lockprof_ops *ops,
+        const char *file, int line)
+{
+    struct lockprof_stats *stats = lockprof_stats_of(slot, mutex);
+    uint64_t start;
+    uint64_t now;
+    int rc;
+
+    if(stats == NULL)
+    {
+        // shared by every mutex without a slot, unlike the per mutex counters
+        atomic_fetch_add_explicit(&lockprof_untracked, 1, memory_order_relaxed);
+        return ops->lock(mutex);
+    }
+
+    rc = ops->trylock(mutex);
+    if(rc == 0)
+    {
+        stats->acquired_ns = lockprof_now_ns();
+        lockprof_add(&stats->acquisitions, 1);
+        return 0;
+    }
+    if(rc != EBUSY)
+    {
+        return rc;
+    }
+
+    start = lockprof_now_ns();
+    rc = ops->lock(mutex);
+    if(rc != 0)
+    {
+        return rc;
+    }
+    now = lockprof_now_ns();
+    stats->acquired_ns = now;
+    lockprof_add(&stats->acquisitions, 1);
+    lockprof_add(&stats->contended, 1);
+    lockprof_add(&stats->wait_ns, now - start);
+    lockprof_max(&stats->max_wait_ns, now - start);
+    lockprof_add(&stats->wait_histogram[lockprof_bucket(now - start)], 1);
+    lockprof_record_site(stats, file, line, now - start);
+    return 0;
+}
+
+static int lockprof_release(void *mutex, _Atomic int *slot, const struct lockprof_ops *ops)
+{
+    int index = atomic_load_explicit(slot, memory_order_relaxed);
+    struct lockprof_stats *stats = index > 0 ? &lockprof_table[index - 1] : NULL;
+
+    if(stats != NULL && stats->acquired_ns != 0)
+    {
+        uint64_t hold_ns = lockprof_now_ns() - stats->acquired_ns;
+
+        // cleared so an unbalanced unlock is not counted twice
+        stats->acquired_ns = 0;
+        lockprof_add(&stats->hold_ns, hold_ns);
+        lockprof_max(&stats->max_hold_ns, hold_ns);
+        lockprof_add(&stats->hold_histogram[lockprof_bucket(hold_ns)], 1);
+    }
+    return ops->unlock(mutex);
+}
+
+int lockprof_init(struct lockprof_mutex *mutex)
+{
+    int rc = pthread_mutex_init(&mutex->mutex, NULL);
+
+    atomic_init(&mutex->slot, 0);
+    if(rc == 0)
+    {
+        lockprof_claim_slot(&mutex->slot, mutex);
+    }
+    return rc;
+}
+
+int lockprof_destroy(struct lockprof_mutex *mutex)
+{
+    lockprof_release_slot(&mutex->slot);
+    return pthread_mutex_destroy(&mutex->mutex);
+}
+
+int lockprof_lock(struct lockprof_mutex *mutex, const char *file, int line)
+{
+    return lockprof_acquire(&mutex->mutex, &mutex->slot, &lockprof_pthread_ops, file, line);
+}
+
+int lockprof_unlock(struct lockprof_mutex *mutex)
+{
+    return lockprof_release(&mutex->mutex, &mutex->slot, &lockprof_pthread_ops);
+}
+
+void lockprof_adaptivelock_init(struct lockprof_adaptivelock *lock)
+{
+    adaptivelock_init(&lock->lock);
+    atomic_init(&lock->slot, 0);
+    lockprof_claim_slot(&lock->slot, lock);
+}
+
+void lockprof_adaptivelock_destroy(struct lockprof_adaptivelock *lock)
+{
+    lockprof_release_slot(&lock->slot);
+}
+
+int lockprof_adaptivelock_lock(struct lockprof_adaptivelock *lock, const char *file, int line)
+{
+    return lockprof_acquire(&lock->lock, &lock->slot, &lockprof_adaptivelock_ops, file, line);
+}
+
+int lockprof_adaptivelock_unlock(struct lockprof_adaptivelock *lock)
+{
+    return lockprof_release(&lock->lock, &lock->slot, &lockprof_adaptivelock_ops);
+}
+
+void lockprof_name_slot(_Atomic int *slot, const void *mutex, const char *name)
+{
+    struct lockprof_stats *stats = lockprof_stats_of(slot, mutex);
+
+    if(stats != NULL)
+    {
+        atomic_store_explicit(&stats->name, name, memory_order_relaxed);
+    }
+}
+
+/**
+ * Format @param ns into @param buffer with a unit which keeps it short
+ */
+static const char *lockprof_format_ns(char *buffer, size_t size, uint64_t ns)
+{
+    if(ns < 10000)
+    {
+        snprintf(buffer, size, "%llu ns", (unsigned long long)ns);
+    }
+    else if(ns < 10000000)
+    {
+        snprintf(buffer, size, "%.1f us", ns / 1e3);
+    }
+    else if(ns < 10000000000ull)
+    {
+        snprintf(buffer, size, "%.1f ms", ns / 1e6);
+    }
+    else
+    {
+        snprintf(buffer, size, "%.1f s", ns / 1e9);
+    }
+    return buffer;
+}
+
+static void lockprof_dump_histogram(FILE *out, const char *title, _Atomic uint64_t *histogram)
+{
+    const char *separator = "";
+    char bound[32];
+    unsigned int i;
+
+    fprintf(out, "  %s:", title);
+    for(i = 0; i < LOCKPROF_HISTOGRAM_BUCKETS; i++)
+    {
+        uint64_t count = atomic_load_explicit(&histogram[i], memory_order_relaxed);
+
+        if(count)
+        {
+            fprintf(out, "%s <%s: %llu", separator, lockprof_format_ns(bound, sizeof(bound), 2ull << i),
+                    (unsigned long long)count);
+            separator = ",";
+        }
+    }
+    fprintf(out, "\n");
+}
+
+static void lockprof_dump_sites(FILE *out, struct lockprof_stats *stats)
+{
+    bool listed[LOCKPROF_MAX_SITES] = { false };
+    char total[32];
+    unsigned int n;
+    size_t i;
+
+    for(n = 0; n < LOCKPROF_TOP_SITES; n++)
+    {
+        struct lockprof_site *top = NULL;
+        uint64_t top_wait_ns = 0;
+        size_t top_index = 0;
+
+        for(i = 0; i < LOCKPROF_MAX_SITES; i++)
+        {
+            struct lockprof_site *site = &stats->sites[i];
+            uint64_t wait_ns = atomic_load_explicit(&site->wait_ns, memory_order_relaxed);
+
+            if(!listed[i] && atomic_load_explicit(&site->contended, memory_order_acquire) &&
+                    (top == NULL || wait_ns > top_wait_ns))
+            {
+                top = site;
+                top_wait_ns = wait_ns;
+                top_index = i;
+            }
+        }
+        if(top == NULL)
+        {
+            break;
+        }
+        listed[top_index] = true;
+        fprintf(out, "  %s:%d waited %s over %llu contended acquisitions\n", top->file, top->line,
+                lockprof_format_ns(total, sizeof(total), top_wait_ns),
+                (unsigned long long)atomic_load_explicit(&top->contended, memory_order_relaxed));
+    }
+    if(atomic_load_explicit(&stats->sites_dropped, memory_order_relaxed))
+    {
+        fprintf(out, "  %llu contended acquisitions from further call sites\n",
+                (unsigned long long)atomic_load_explicit(&stats->sites_dropped, memory_order_relaxed));
+    }
+}
+
+void lockprof_dump(FILE *out)
+{
+    char total[32];
+    char max[32];
+    size_t i;
+
+    for(i = 0; i < LOCKPROF_MAX_MUTEXES; i++)
+    {
+        struct lockprof_stats *stats = &lockprof_table[i];
+        const void *mutex = atomic_load_explicit(&stats->mutex, memory_order_acquire);
+        const char *name = atomic_load_explicit(&stats->name, memory_order_relaxed);
+        uint64_t acquisitions = atomic_load_explicit(&stats->acquisitions, memory_order_relaxed);
+        uint64_t contended = atomic_load_explicit(&stats->contended, memory_order_relaxed);
+
+        if(mutex == NULL || acquisitions == 0)
+        {
+            continue;
+        }
+        fprintf(out, "lockprof: mutex %s (%p): %llu acquisitions, %llu contended (%.1f%%)\n",
+                name ? name : "unnamed", (void *)mutex, (unsigned long long)acquisitions,
+                (unsigned long long)contended, 100.0 * contended / acquisitions);
+        fprintf(out, "  wait: total %s, max %s\n",
+                lockprof_format_ns(total, sizeof(total), atomic_load_explicit(&stats->wait_ns, memory_order_relaxed)),
+                lockprof_format_ns(max, sizeof(max), atomic_load_explicit(&stats->max_wait_ns, memory_order_relaxed)));
+        fprintf(out, "  hold: total %s, max %s\n",
+                lockprof_format_ns(total, sizeof(total), atomic_load_explicit(&stats->hold_ns, memory_order_relaxed)),
+                lockprof_format_ns(max, sizeof(max), atomic_load_explicit(&stats->max_hold_ns, memory_order_relaxed)));
+        if(contended)
+        {
+            lockprof_dump_histogram(out, "contended wait histogram", stats->wait_histogram);
+        }
+        lockprof_dump_histogram(out, "hold histogram", stats->hold_histogram);
+        lockprof_dump_sites(out, stats);
+    }
+    if(atomic_load_explicit(&lockprof_untracked, memory_order_relaxed))
+    {
+        fprintf(out, "lockprof: %llu acquisitions of mutexes which found all %d slots taken were not profiled\n",
+                (unsigned long long)atomic_load_explicit(&lockprof_untracked, memory_order_relaxed),
+                LOCKPROF_MAX_MUTEXES);
+    }
+    fflush(out);
+}
+
+void lockprof_reset(void)
+{
+    size_t i;
+
+    for(i = 0; i < LOCKPROF_MAX_MUTEXES; i++)
+    {
+        lockprof_clear(&lockprof_table[i]);
+    }
+    atomic_store(&lockprof_untracked, 0);
+}
@@ -0,0 +1,176 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "adaptivelock.h"
+
+/**
+ * Contention profiling for pthread mutexes and adaptive locks.
+ * A profiled lock is a struct lockprof_mutex or a struct lockprof_adaptivelock, which pair the lock
+ * with the slot of its statistics.  lockprof_mutex_t is the lock of modules which may be profiled:
+ * built with LOCKPROF defined it is one of these, and lockprof_mutex_lock() and
+ * lockprof_mutex_unlock() record, per mutex, the number of acquisitions and of contended
+ * acquisitions, histograms of the time spent waiting for and holding the mutex and the call sites
+ * which waited the longest.  Without LOCKPROF it is the plain lock, the macros are the lock
+ * functions and cost nothing.  A plain pthread_mutex_t or struct adaptivelock may also be passed
+ * to the macros, it is then locked without statistics.
+ *
+ * lockprof_mutex_init() claims one of LOCKPROF_MAX_MUTEXES statistics slots and stores it in the
+ * mutex, lockprof_mutex_destroy() releases it along with the statistics of the mutex.  A mutex set
+ * up with LOCKPROF_MUTEX_INITIALIZER claims its slot on its first lock.  Locking never searches the
+ * slots.  Statistics are only updated by the holder of a mutex, so profiling adds no shared cache
+ * line traffic besides the mutex itself.
+ * Once a mutex has been profiled, the statistics are written at exit to the file named by the
+ * LOCKPROF_OUTPUT environment variable, or to stderr.
+ */
+
+// Most mutexes profiled at the same time, further mutexes are locked without statistics
+#define LOCKPROF_MAX_MUTEXES 64
+
+// Most distinct call sites recorded per mutex
+#define LOCKPROF_MAX_SITES 16
+
+// Histogram bucket i counts durations of [2^i, 2^(i+1)) nanoseconds, bucket 0 also counts 0
+#define LOCKPROF_HISTOGRAM_BUCKETS 40
+
+/**
+ * slot is the index of the statistics of the mutex plus one, 0 until it is claimed and -1 when
+ * every slot was taken
+ */
+struct lockprof_mutex
+{
+    pthread_mutex_t mutex;
+    _Atomic int slot;
+};
+
+struct lockprof_adaptivelock
+{
+    struct adaptivelock lock;
+    _Atomic int slot;
+};
+
+#define LOCKPROF_PTHREAD_MUTEX_INITIALIZER { PTHREAD_MUTEX_INITIALIZER, 0 }
+#define LOCKPROF_ADAPTIVELOCK_INITIALIZER { ADAPTIVELOCK_INITIALIZER, 0 }
+
+/**
+ * The mutex of modules which may use either lock, the adaptive lock when built with ADAPTIVELOCK
+ * defined, for critical sections short enough to be worth spinning for.
+ * Not usable with condition variables.
+ */
+#ifdef LOCKPROF
+#ifdef ADAPTIVELOCK
+typedef struct lockprof_adaptivelock lockprof_mutex_t;
+#define LOCKPROF_MUTEX_INITIALIZER LOCKPROF_ADAPTIVELOCK_INITIALIZER
+#else
+typedef struct lockprof_mutex lockprof_mutex_t;
+#define LOCKPROF_MUTEX_INITIALIZER LOCKPROF_PTHREAD_MUTEX_INITIALIZER
+#endif
+#define lockprof_mutex_init(mutex) _Generic((mutex), \
+        struct lockprof_adaptivelock *: lockprof_adaptivelock_init, \
+        default: lockprof_init)(mutex)
+#define lockprof_mutex_destroy(mutex) _Generic((mutex), \
+        struct lockprof_adaptivelock *: lockprof_adaptivelock_destroy, \
+        default: lockprof_destroy)(mutex)
+#define lockprof_mutex_lock(mutex) _Generic((mutex), \
+        struct lockprof_mutex *: lockprof_lock, \
+        struct lockprof_adaptivelock *: lockprof_adaptivelock_lock, \
+        struct adaptivelock *: lockprof_plain_adaptivelock_lock, \
+        default: lockprof_plain_lock)((mutex), __FILE__, __LINE__)
+#define lockprof_mutex_unlock(mutex) _Generic((mutex), \
+        struct lockprof_mutex *: lockprof_unlock, \
+        struct lockprof_adaptivelock *: lockprof_adaptivelock_unlock, \
+        struct adaptivelock *: adaptivelock_unlock, \
+        default: pthread_mutex_unlock)(mutex)
+#define lockprof_set_name(mutex, name) lockprof_name_slot(&(mutex)->slot, (mutex), (name))
+#else
+#ifdef ADAPTIVELOCK
+typedef struct adaptivelock lockprof_mutex_t;
+#define LOCKPROF_MUTEX_INITIALIZER ADAPTIVELOCK_INITIALIZER
+#define lockprof_mutex_init(mutex) adaptivelock_init(mutex)
+#define lockprof_mutex_destroy(mutex) ((void)(mutex))
+#else
+typedef pthread_mutex_t lockprof_mutex_t;
+#define LOCKPROF_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define lockprof_mutex_init(mutex) pthread_mutex_init((mutex), NULL)
+#define lockprof_mutex_destroy(mutex) pthread_mutex_destroy(mutex)
+#endif
+#define lockprof_mutex_lock(mutex) _Generic((mutex), \
+        struct adaptivelock *: adaptivelock_lock, \
+        default: pthread_mutex_lock)(mutex)
+#define lockprof_mutex_unlock(mutex) _Generic((mutex), \
+        struct adaptivelock *: adaptivelock_unlock, \
+        default: pthread_mutex_unlock)(mutex)
+#define lockprof_set_name(mutex, name) ((void)(mutex), (void)(name))
+#endif
+
+/**
+* Initialize @param mutex and claim a statistics slot for it.
+* @return the result of pthread_mutex_init()
+*/
+int lockprof_init(struct lockprof_mutex *mutex);
+
+/**
+* Release the statistics slot of @param mutex, discarding its statistics, and destroy it.
+* @return the result of pthread_mutex_destroy()
+*/
+int lockprof_destroy(struct lockprof_mutex *mutex);
+
+/**
+* Lock @param mutex, recording the wait against the call site @param file and @param line.
+* @return the result of pthread_mutex_lock()
+*/
+int lockprof_lock(struct lockprof_mutex *mutex, const char *file, int line);
+
+/**
+* Unlock @param mutex, recording how long it was held.
+* @return the result of pthread_mutex_unlock()
+*/
+int lockprof_unlock(struct lockprof_mutex *mutex);
+
+/**
+* lockprof_init(), lockprof_destroy(), lockprof_lock() and lockprof_unlock() for an adaptive lock
+*/
+void lockprof_adaptivelock_init(struct lockprof_adaptivelock *lock);
+void lockprof_adaptivelock_destroy(struct lockprof_adaptivelock *lock);
+int lockprof_adaptivelock_lock(struct lockprof_adaptivelock *lock, const char *file, int line);
+int lockprof_adaptivelock_unlock(struct lockprof_adaptivelock *lock);
+
+/**
+* Lock a plain mutex or adaptive lock, without statistics, for lockprof_mutex_lock()
+*/
+static inline int lockprof_plain_lock(pthread_mutex_t *mutex, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    return pthread_mutex_lock(mutex);
+}
+
+static inline int lockprof_plain_adaptivelock_lock(struct adaptivelock *lock, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    return adaptivelock_lock(lock);
+}
+
+/**
+* Name the mutex at @param mutex, whose statistics slot is @param slot, as @param name in reports,
+* claiming the slot if the mutex has none yet.  @param name must stay valid.
+* Does nothing when the profiler is full.  Use lockprof_set_name(mutex, name).
+*/
+void lockprof_name_slot(_Atomic int *slot, const void *mutex, const char *name);
+
+/**
+* Write the statistics of every profiled mutex to @param out.
+* May be called while other threads lock and unlock, the counters of a mutex are then read
+* part way through an update and may be off by one acquisition.
+*/
+void lockprof_dump(FILE *out);
+
+/**
+* Discard the statistics of every profiled mutex, for instance after a warm up.
+* Must not be called while a profiled mutex is held.
+*/
+void lockprof_reset(void);
+
+#endif
@@ -84,3 +84,16 @@ bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int
     return true;
 }
 
+
+struct threadpool_future *submit_task_obtaining_mutex(struct threadpool *pool, struct thread_data *thread_data)
+{
+    struct threadpool_future *future;
+
+    thread_data->thread_complete_success = false;
+    future = threadpool_submit(pool, threadfunc, thread_data);
+    if(future == NULL)
+    {
+        ERROR_LOG("Failed to queue task");
+    }
+    return future;
+}
@@ -1,5 +1,6 @@
 #include <stdbool.h>
 #include <pthread.h>
+#include "threadpool.h"
 
 /**
  * This structure should be dynamically allocated and passed as
@@ -43,3 +44,12 @@ struct thread_data{
 * @return true if the thread could be started, false if a failure occurred.
 */
 bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int wait_to_obtain_ms, int wait_to_release_ms);
+
+/**
+* Queue the wait, obtain, hold and release sequence described by @param thread_data on a worker of
+* @param pool instead of starting a thread for it.  The caller owns @param thread_data, which must
+* have its mutex and wait fields set and stay valid until the returned future is waited for.
+* threadpool_future_wait() returns @param thread_data, with thread_complete_success set.
+* @return the future of the task, or NULL if it could not be queued.
+*/
+struct threadpool_future *submit_task_obtaining_mutex(struct threadpool *pool, struct thread_data *thread_data);
@@ -0,0 +1,440 @@
+#include "threadpool.h"
+#include "lockprof.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Optional: use these functions to add debug or error prints to your application
+#define DEBUG_LOG(msg,...)
+//#define DEBUG_LOG(msg,...) printf("threadpool: " msg "\n" , ##__VA_ARGS__)
+#define ERROR_LOG(msg,...) printf("threadpool ERROR: " msg "\n" , ##__VA_ARGS__)
+
+#define THREADPOOL_DEQUE_INITIAL_CAPACITY 64
+
+/**
+ * A submitted task, which is also its future.  Recycled through the free list of the pool.
+ */
+struct threadpool_future
+{
+    struct threadpool *pool;
+    threadpool_fn fn;
+    void *arg;
+    void *result;
+    atomic_bool done;
+    struct threadpool_future *next_free;
+    struct threadpool_future *next_allocated;
+};
+
+/**
+ * Tasks of one worker, a ring used as a deque: the owner pushes and pops at the tail,
+ * thieves take from the head.  Each deque has its own lock, so workers only contend
+ * when one of them steals.
+ */
+struct threadpool_deque
+{
+    lockprof_mutex_t lock;
+    struct threadpool_future **tasks;
+    size_t capacity; // a power of two
+    size_t head;     // index of the oldest task
+    size_t count;
+};
+
+struct threadpool
+{
+    unsigned int nr_workers;
+    unsigned int nr_threads;    // workers started, lower than nr_workers only while creating
+    pthread_t *threads;
+    struct threadpool_deque *deques;
+    atomic_uint next_deque;     // round robin position for submissions from other threads
+    atomic_size_t pending;      // tasks queued and not yet taken
+    atomic_uint sleepers;       // workers blocked, or about to block, on work_cond
+    atomic_uint waiters;        // threads blocked, or about to block, on done_cond
+    pthread_mutex_t lock;       // protects stopping and the waits on the conditions below
+    pthread_cond_t work_cond;   // signalled when a task is queued
+    pthread_cond_t done_cond;   // broadcast when a task completes and someone waits
+    bool stopping;
+    lockprof_mutex_t free_lock; // protects free_tasks and allocated_tasks
+    struct threadpool_future *free_tasks;
+    struct threadpool_future *allocated_tasks;
+};
+
+/**
+ * Pool and deque of the worker running on this thread, NULL on other threads
+ */
+static __thread struct threadpool *current_pool;
+static __thread unsigned int current_worker;
+
+struct threadpool_worker_arg
+{
+    struct threadpool *pool;
+    unsigned int index;
+};
+
+static bool deque_push(struct threadpool_deque *deque, struct threadpool_future *task)
+{
+    lockprof_mutex_lock(&deque->lock);
+    if(deque->count == deque->capacity)
+    {
+        size_t capacity = deque->capacity * 2;
+        struct threadpool_future **tasks = malloc(capacity * sizeof(*tasks));
+        size_t i;
+
+        if(!tasks)
+        {
+            lockprof_mutex_unlock(&deque->lock);
+            return false;
+        }
+        for(i = 0; i < deque->count; i++)
+        {
+            tasks[i] = deque->tasks[(deque->head + i) & (deque->capacity - 1)];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+        deque->head = 0;
+    }
+    deque->tasks[(deque->head + deque->count) & (deque->capacity - 1)] = task;
+    deque->count++;
+    lockprof_mutex_unlock(&deque->lock);
+    return true;
+}
+
+/**
+ * Take the newest task of @param deque, as its owner, or the oldest when @param steal is set
+ */
+static struct threadpool_future *deque_take(struct threadpool_deque *deque, bool steal)
+{
+    struct threadpool_future *task = NULL;
+
+    lockprof_mutex_lock(&deque->lock);
+    if(deque->count)
+    {
+        deque->count--;
+        if(steal)
+        {
+            task = deque->tasks[deque->head];
+            deque->head = (deque->head + 1) & (deque->capacity - 1);
+        }
+        else
+        {
+            task = deque->tasks[(deque->head + deque->count) & (deque->capacity - 1)];
+        }
+    }
+    lockprof_mutex_unlock(&deque->lock);
+    return task;
+}
+
+/**
+ * Find a task to run, from the deque of this worker first and then from the others
+ */
+static struct threadpool_future *threadpool_take(struct threadpool *pool)
+{
+    struct threadpool_future *task = NULL;
+    unsigned int start = 0;
+    unsigned int i;
+
+    if(atomic_load(&pool->pending) == 0)
+    {
+        return NULL;
+    }
+    if(current_pool == pool)
+    {
+        task = deque_take(&pool->deques[current_worker], false);
+        start = current_worker + 1;
+    }
+    for(i = 0; !task && i < pool->nr_workers; i++)
+    {
+        task = deque_take(&pool->deques[(start + i) % pool->nr_workers], true);
+    }
+    if(task)
+    {
+        atomic_fetch_sub(&pool->pending, 1);
+    }
+    return task;
+}
+
+static void threadpool_run(struct threadpool *pool, struct threadpool_future *task)
+{
+    task->result = task->fn(task->arg);
+    // pairs with the waiters check in threadpool_future_wait(), one of the two sides sees the other
+    atomic_store(&task->done, true);
+    if(atomic_load(&pool->waiters))
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void *threadpool_worker(void *thread_param)
+{
+    struct threadpool_worker_arg *worker = thread_param;
+    struct threadpool *pool = worker->pool;
+    struct threadpool_future *task;
+
+    current_pool = pool;
+    current_worker = worker->index;
+    free(worker);
+
+    for(;;)
+    {
+        task = threadpool_take(pool);
+        if(task)
+        {
+            threadpool_run(pool, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        // pairs with the sleepers check in threadpool_submit()
+        atomic_fetch_add(&pool->sleepers, 1);
+        while(atomic_load(&pool->pending) == 0 && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        if(pool->stopping && atomic_load(&pool->pending) == 0)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+
+/**
+ * calloc() for the pool and its deques, which an adaptive lock aligns to cache lines
+ */
+static void *threadpool_zalloc(size_t size)
+{
+    size_t alignment = _Alignof(lockprof_mutex_t) > sizeof(void *) ? _Alignof(lockprof_mutex_t) : sizeof(void *);
+    // aligned_alloc() wants a multiple of the alignment
+    void *memory = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+
+    if(memory)
+    {
+        memset(memory, 0, size);
+    }
+    return memory;
+}
+
+struct threadpool *threadpool_create(unsigned int nr_workers)
+{
+    struct threadpool *pool;
+    unsigned int i;
+
+    if(nr_workers == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nr_workers = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    pool = threadpool_zalloc(sizeof(*pool));
+    if(!pool)
+    {
+        return NULL;
+    }
+    pool->nr_workers = nr_workers;
+    pool->threads = calloc(nr_workers, sizeof(*pool->threads));
+    pool->deques = threadpool_zalloc(nr_workers * sizeof(*pool->deques));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    lockprof_mutex_init(&pool->free_lock);
+    if(!pool->threads || !pool->deques)
+    {
+        ERROR_LOG("Failed to allocate memory for %u workers", nr_workers);
+        pool->nr_workers = 0;
+        threadpool_destroy(pool);
+        return NULL;
+    }
+    for(i = 0; i < nr_workers; i++)
+    {
+        lockprof_mutex_init(&pool->deques[i].lock);
+        pool->deques[i].capacity = THREADPOOL_DEQUE_INITIAL_CAPACITY;
+        pool->deques[i].tasks = malloc(THREADPOOL_DEQUE_INITIAL_CAPACITY * sizeof(*pool->deques[i].tasks));
+        if(!pool->deques[i].tasks)
+        {
+            ERROR_LOG("Failed to allocate memory for the deque of worker %u", i);
+            threadpool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    for(i = 0; i < nr_workers; i++)
+    {
+        struct threadpool_worker_arg *worker = malloc(sizeof(*worker));
+
+        if(!worker)
+        {
+            ERROR_LOG("Failed to allocate memory for worker %u", i);
+            threadpool_destroy(pool);
+            return NULL;
+        }
+        worker->pool = pool;
+        worker->index = i;
+        if(pthread_create(&pool->threads[i], NULL, threadpool_worker, worker) != 0)
+        {
+            ERROR_LOG("Failed to create worker %u", i);
+            free(worker);
+            threadpool_destroy(pool);
+            return NULL;
+        }
+        pool->nr_threads++;
+    }
+    return pool;
+}
+
+void threadpool_destroy(struct threadpool *pool)
+{
+    struct threadpool_future *task;
+    unsigned int i;
+
+    if(!pool)
+    {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for(i = 0; i < pool->nr_threads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for(i = 0; i < pool->nr_workers; i++)
+    {
+        // a deque after one which failed to allocate is still zeroed, which destroys like an
+        // unused statically initialized lock
+        free(pool->deques[i].tasks);
+        lockprof_mutex_destroy(&pool->deques[i].lock);
+    }
+    while((task = pool->allocated_tasks))
+    {
+        pool->allocated_tasks = task->next_allocated;
+        free(task);
+    }
+    lockprof_mutex_destroy(&pool->free_lock);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * Take a task object from the free list of @param pool, allocating one when it is empty
+ */
+static struct threadpool_future *threadpool_get_task(struct threadpool *pool)
+{
+    struct threadpool_future *task;
+
+    lockprof_mutex_lock(&pool->free_lock);
+    task = pool->free_tasks;
+    if(task)
+    {
+        pool->free_tasks = task->next_free;
+    }
+    else
+    {
+        task = malloc(sizeof(*task));
+        if(task)
+        {
+            task->pool = pool;
+            task->next_allocated = pool->allocated_tasks;
+            pool->allocated_tasks = task;
+        }
+    }
+    lockprof_mutex_unlock(&pool->free_lock);
+    return task;
+}
+
+static void threadpool_put_task(struct threadpool *pool, struct threadpool_future *task)
+{
+    lockprof_mutex_lock(&pool->free_lock);
+    task->next_free = pool->free_tasks;
+    pool->free_tasks = task;
+    lockprof_mutex_unlock(&pool->free_lock);
+}
+
+struct threadpool_future *threadpool_submit(struct threadpool *pool, threadpool_fn fn, void *arg)
+{
+    struct threadpool_future *task = threadpool_get_task(pool);
+    unsigned int index;
+
+    if(!task)
+    {
+        ERROR_LOG("Failed to allocate memory for a task");
+        return NULL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->result = NULL;
+    atomic_store(&task->done, false);
+
+    if(current_pool == pool)
+    {
+        index = current_worker;
+    }
+    else
+    {
+        index = atomic_fetch_add(&pool->next_deque, 1) % pool->nr_workers;
+    }
+    if(!deque_push(&pool->deques[index], task))
+    {
+        ERROR_LOG("Failed to grow the deque of worker %u", index);
+        threadpool_put_task(pool, task);
+        return NULL;
+    }
+    // pairs with the pending check in threadpool_worker(), one of the two sides sees the other
+    atomic_fetch_add(&pool->pending, 1);
+    if(atomic_load(&pool->sleepers))
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    DEBUG_LOG("Queued task %p on worker %u", (void *)task, index);
+    return task;
+}
+
+bool threadpool_future_done(struct threadpool_future *future)
+{
+    return atomic_load(&future->done);
+}
+
+void *threadpool_future_wait(struct threadpool_future *future)
+{
+    struct threadpool *pool = future->pool;
+    struct threadpool_future *task;
+    void *result;
+
+    while(!atomic_load(&future->done))
+    {
+        // help instead of blocking, this also keeps a worker waiting on its own subtasks from deadlocking
+        task = threadpool_take(pool);
+        if(task)
+        {
+            threadpool_run(pool, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        // pairs with the waiters check in threadpool_run()
+        atomic_fetch_add(&pool->waiters, 1);
+        while(!atomic_load(&future->done) && atomic_load(&pool->pending) == 0)
+        {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->waiters, 1);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    result = future->result;
+    threadpool_put_task(pool, future);
+    return result;
+}
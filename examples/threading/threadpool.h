@@ -0,0 +1,49 @@
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * A fixed set of worker threads running submitted tasks.
+ * Each worker owns a deque of tasks: it runs its own tasks newest first and, when it runs
+ * out, steals the oldest task of another worker.  Tasks submitted from a worker go to its
+ * own deque, tasks submitted from other threads are spread round robin.
+ */
+struct threadpool;
+
+/**
+ * Completion handle of a submitted task, valid until passed to threadpool_future_wait()
+ */
+struct threadpool_future;
+
+typedef void *(*threadpool_fn)(void *arg);
+
+/**
+* Create a pool of @param nr_workers threads, 0 for one per online CPU.
+* @return the pool or NULL on failure
+*/
+struct threadpool *threadpool_create(unsigned int nr_workers);
+
+/**
+* Run the tasks still queued in @param pool, stop its workers and free it.
+* Futures of tasks which were not waited for are freed with it.
+*/
+void threadpool_destroy(struct threadpool *pool);
+
+/**
+* Queue @param fn to be called with @param arg by a worker of @param pool.
+* Task objects are recycled, so submitting does not allocate once the pool is warm.
+* @return the future of the task, which must be passed to threadpool_future_wait() exactly once,
+*   or NULL on failure
+*/
+struct threadpool_future *threadpool_submit(struct threadpool *pool, threadpool_fn fn, void *arg);
+
+/**
+* @return true if the task of @param future has completed, threadpool_future_wait() will not block
+*/
+bool threadpool_future_done(struct threadpool_future *future);
+
+/**
+* Wait for the task of @param future to complete, running other queued tasks meanwhile,
+* and release @param future.
+* @return the value returned by the task function
+*/
+void *threadpool_future_wait(struct threadpool_future *future);
@@ -52,10 +52,8 @@ fi
 #make clean
 #make
 
-for i in $( seq 1 $NUMFILES)
-do
-	writer "$WRITEDIR/${username}$i.txt" "$WRITESTR"
-done
+# one writer process creates all the files, $WRITEDIR/${username}1.txt to ${username}$NUMFILES.txt
+writer -n "$NUMFILES" "$WRITEDIR" "$username" "$WRITESTR"
 
 OUTPUTSTRING=$(finder.sh "$WRITEDIR" "$WRITESTR")
 echo $OUTPUTSTRING > /tmp/assignment4-result.txt
@@ -0,0 +1,354 @@
+#define _GNU_SOURCE // memmem()
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//2 arguments, like finder.sh
+//first argument is the directory to search
+//second argument is the string to search for
+//
+//prints the same line as finder.sh: the number of regular files below the directory and the
+//number of occurrences of the string in them, which is what grep -r -o | wc -l counts when the
+//string has no regular expression special characters.
+//The tree is walked once, by one worker per CPU, each listing directories with getdents64 and
+//scanning the files it finds with memmem.
+//
+//grep treats a file as binary when its data has a NUL byte, or in a multibyte locale an
+//encoding error, and prints no match lines for it from then on.  A NUL in the first
+//FINDER_BINARY_PROBE bytes is seen by grep before it prints anything, so the file counts 0.
+//Where grep would stop part way depends on its buffer size, so for a NUL further in, or any
+//non ASCII byte in a multibyte locale, finder prints nothing and exits with status 2 to let
+//the caller count with grep instead.
+
+// Bytes read from a file at once, also the getdents64 buffer size
+#define FINDER_BUFFER_SIZE (128 * 1024)
+
+// Bytes grep reads before deciding a file is binary, its smallest first read
+#define FINDER_BINARY_PROBE (32 * 1024)
+
+// Exit status when grep must be used to get its counts
+#define FINDER_EXIT_UNSURE 2
+
+// Layout of the records returned by getdents64, which glibc does not declare
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+ * A directory waiting to be listed
+ */
+struct finder_dir {
+    char *path;
+    struct finder_dir *next;
+};
+
+/**
+ * State shared by the workers.  pending counts the directories queued or being listed, the
+ * walk is over when it drops to 0.
+ */
+struct finder {
+    const char *needle;
+    size_t needle_len;
+    bool multibyte; // the locale has multibyte characters, whose encoding errors grep checks for
+    atomic_bool unsure; // a file was found which grep may count differently
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct finder_dir *queue;
+    long pending;
+    long files;
+    long matches;
+};
+
+/**
+ * Queue @param path, which the queue then owns, for listing
+ * @return 0 on success, -1 when out of memory
+ */
+static int finder_push(struct finder *finder, char *path) {
+    struct finder_dir *dir = malloc(sizeof(*dir));
+
+    if (dir == NULL) {
+        free(path);
+        return -1;
+    }
+    dir->path = path;
+    pthread_mutex_lock(&finder->lock);
+    dir->next = finder->queue;
+    finder->queue = dir;
+    finder->pending++;
+    pthread_cond_signal(&finder->cond);
+    pthread_mutex_unlock(&finder->lock);
+    return 0;
+}
+
+/**
+ * Wait for a directory to list
+ * @return its path, to be passed to finder_done() once listed, or NULL when the walk is over
+ */
+static char *finder_pop(struct finder *finder) {
+    struct finder_dir *dir;
+    char *path = NULL;
+
+    pthread_mutex_lock(&finder->lock);
+    while (finder->queue == NULL && finder->pending > 0) {
+        pthread_cond_wait(&finder->cond, &finder->lock);
+    }
+    dir = finder->queue;
+    if (dir) {
+        finder->queue = dir->next;
+        path = dir->path;
+    }
+    pthread_mutex_unlock(&finder->lock);
+    free(dir);
+    return path;
+}
+
+static void finder_done(struct finder *finder) {
+    pthread_mutex_lock(&finder->lock);
+    if (--finder->pending == 0) {
+        pthread_cond_broadcast(&finder->cond);
+    }
+    pthread_mutex_unlock(&finder->lock);
+}
+
+/**
+ * @return true if the @param size bytes at @param data have a byte grep could take for an
+ * encoding error, any byte outside ASCII since finder does not decode characters
+ */
+static bool finder_has_non_ascii(const char *data, size_t size) {
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if ((unsigned char)data[i] >= 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Count the non-overlapping occurrences of the needle in the file @param name of @param dirfd,
+ * using @param buffer of FINDER_BUFFER_SIZE bytes, like grep -o counts them
+ * @return the count, 0 for a file grep finds binary before printing, -1 for a file grep may
+ * count differently
+ */
+static long finder_scan(struct finder *finder, int dirfd, const char *name, char *buffer) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    size_t have = 0;
+    off_t offset = 0;
+    long count = 0;
+    ssize_t bytes;
+
+    if (fd == -1) {
+        return 0;
+    }
+    while ((bytes = read(fd, buffer + have, FINDER_BUFFER_SIZE - have)) > 0) {
+        char *end = buffer + have + bytes;
+        char *from = buffer;
+        char *nul = memchr(buffer + have, '\0', bytes);
+        char *hit;
+        char *keep;
+
+        if (nul) {
+            close(fd);
+            return offset + (nul - (buffer + have)) < FINDER_BINARY_PROBE ? 0 : -1;
+        }
+        if (finder->multibyte && finder_has_non_ascii(buffer + have, bytes)) {
+            close(fd);
+            return -1;
+        }
+        offset += bytes;
+
+        while ((hit = memmem(from, end - from, finder->needle, finder->needle_len)) != NULL) {
+            count++;
+            from = hit + finder->needle_len;
+        }
+        // the last needle_len - 1 bytes may start an occurrence completed by the next read,
+        // unless they belong to an occurrence already counted
+        keep = end - from < (ptrdiff_t)finder->needle_len ? from : end - (finder->needle_len - 1);
+        have = end - keep;
+        memmove(buffer, keep, have);
+    }
+    close(fd);
+    return count;
+}
+
+/**
+ * Join @param dir and @param name into a newly allocated path
+ */
+static char *finder_join(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+
+    if (path) {
+        memcpy(path, dir, dir_len);
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+    }
+    return path;
+}
+
+/**
+ * List the directory @param path, queueing its subdirectories and scanning its regular files.
+ * Symbolic links are not followed, like find and grep -r.
+ */
+static void finder_list(struct finder *finder, const char *path, char *dirents, char *buffer,
+        long *files, long *matches) {
+    int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    long bytes;
+    long offset;
+
+    if (dirfd == -1) {
+        return;
+    }
+    while ((bytes = syscall(SYS_getdents64, dirfd, dirents, FINDER_BUFFER_SIZE)) > 0) {
+        for (offset = 0; offset < bytes; ) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(dirents + offset);
+            unsigned char type = entry->d_type;
+
+            offset += entry->d_reclen;
+            if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' ||
+                    (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+                continue;
+            }
+            if (type == DT_UNKNOWN) {
+                // some file systems leave the type to stat
+                struct stat st;
+
+                if (fstatat(dirfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR) {
+                char *subdir = finder_join(path, entry->d_name);
+
+                if (subdir) {
+                    finder_push(finder, subdir);
+                }
+            } else if (type == DT_REG) {
+                long count = finder_scan(finder, dirfd, entry->d_name, buffer);
+
+                (*files)++;
+                if (count == -1) {
+                    atomic_store(&finder->unsure, true);
+                } else {
+                    *matches += count;
+                }
+            }
+        }
+    }
+    close(dirfd);
+}
+
+static void *finder_worker(void *arg) {
+    struct finder *finder = arg;
+    char *dirents = malloc(FINDER_BUFFER_SIZE);
+    char *buffer = malloc(FINDER_BUFFER_SIZE);
+    long files = 0;
+    long matches = 0;
+    char *path;
+
+    if (dirents == NULL || buffer == NULL) {
+        // skipping directories would print wrong counts
+        perror("malloc");
+        exit(1);
+    }
+    while ((path = finder_pop(finder)) != NULL) {
+        // once grep is needed anyway the rest of the walk is only drained
+        if (!atomic_load_explicit(&finder->unsure, memory_order_relaxed)) {
+            finder_list(finder, path, dirents, buffer, &files, &matches);
+        }
+        free(path);
+        finder_done(finder);
+    }
+    free(dirents);
+    free(buffer);
+
+    pthread_mutex_lock(&finder->lock);
+    finder->files += files;
+    finder->matches += matches;
+    pthread_mutex_unlock(&finder->lock);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    struct finder finder = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+    long nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *threads;
+    struct stat st;
+    char *root;
+    long started;
+    long i;
+
+    setlocale(LC_CTYPE, "");
+    finder.multibyte = MB_CUR_MAX > 1;
+    if (argc != 3) {
+        printf("Error: invalid number of arguments\n");
+        return 1;
+    }
+    if (stat(argv[1], &st) == -1 || !S_ISDIR(st.st_mode)) {
+        printf("Error: %s is not a directory\n", argv[1]);
+        return 1;
+    }
+    if (argv[2][0] == '\0') {
+        printf("Error: search string is empty\n");
+        return 1;
+    }
+    finder.needle = argv[2];
+    finder.needle_len = strlen(argv[2]);
+    if (finder.needle_len >= FINDER_BUFFER_SIZE) {
+        printf("Error: search string is too long\n");
+        return 1;
+    }
+
+    root = strdup(argv[1]);
+    if (root == NULL || finder_push(&finder, root) == -1) {
+        perror("malloc");
+        return 1;
+    }
+    if (nr_threads < 1) {
+        nr_threads = 1;
+    }
+    threads = calloc(nr_threads, sizeof(*threads));
+    if (threads == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    // the calling thread is one of the workers
+    for (started = 1; started < nr_threads; started++) {
+        if (pthread_create(&threads[started], NULL, finder_worker, &finder) != 0) {
+            break;
+        }
+    }
+    finder_worker(&finder);
+    for (i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    if (atomic_load(&finder.unsure)) {
+        return FINDER_EXIT_UNSURE;
+    }
+    printf("The number of files are %ld and the number of matching lines are %ld\n",
+            finder.files, finder.matches);
+    return 0;
+}
@@ -25,6 +25,23 @@ if [ -z "$searchstr" ]; then
   exit 1
 fi
 
+#use the native finder when installed, it walks the tree once with a thread per CPU
+#it searches for a plain string, so only when searchstr has no regular expression characters,
+#nor the whitespace the unquoted pipeline below splits on, to print the same counts
+#it exits with status 2, printing nothing, when a file holds data grep may count differently
+case "$searchstr" in
+  *[].[*^\$\\\ \	]*) ;;
+  *)
+    if command -v finder > /dev/null 2>&1; then
+      finder "$filesdir" "$searchstr"
+      status=$?
+      if [ $status -ne 2 ]; then
+        exit $status
+      fi
+    fi
+    ;;
+esac
+
 #count the number of files in the directory and all subdirectories
 num_files=$(find $filesdir -type f | wc -l)
 
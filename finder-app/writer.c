@@ -1,13 +1,311 @@
+#define _GNU_SOURCE // fallocate()
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <syslog.h>
+#include <unistd.h>
 
 //2 arguments
 //first argument is path to the file
 //second argument is the string to write to the file
+//
+//bulk modes, which create many files from one process:
+//-n <count> [-j <threads>] <dir> <prefix> <string>
+//  writes the string to <dir>/<prefix>1.txt up to <dir>/<prefix><count>.txt
+//-m [-j <threads>] <dir>
+//  reads a manifest of "<path><TAB><string>" lines on stdin and writes each string to <dir>/<path>
+//<dir> is created if needed, the directories of manifest paths must exist
+
+// Files at least this large are preallocated, smaller ones take a single write anyway
+#define WRITER_FALLOCATE_MIN 4096
+
+// Files a thread claims at once, so threads do not fight over the shared index
+#define WRITER_BATCH 64
+
+struct manifest_entry {
+    char *path; // the manifest line, cut at the tab
+    const char *data;
+    size_t size;
+};
+
+struct bulk_job {
+    int dirfd;
+    long count;
+    // -n: every file gets data, manifest is NULL
+    const char *prefix;
+    const char *data;
+    size_t size;
+    struct manifest_entry *manifest;
+    atomic_long next;
+    atomic_long failures;
+};
+
+static void usage(const char *name) {
+    printf("Usage: %s <file> <string>\n", name);
+    printf("       %s -n <count> [-j <threads>] <dir> <prefix> <string>\n", name);
+    printf("       %s -m [-j <threads>] <dir> < manifest\n", name);
+}
+
+/**
+ * Parse the whole of @param text as a decimal count into @param value
+ * @return 0 on success, -1 when @param text is empty, has trailing characters, is negative or
+ * out of range
+ */
+static int parse_count(const char *text, long *value) {
+    char *end;
+
+    errno = 0;
+    *value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || *value < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Write @param size bytes of @param data to @param path, relative to @param dirfd
+ * @return 0 on success, -1 with errno set on failure
+ */
+static int write_file(int dirfd, const char *path, const char *data, size_t size) {
+    int fd = openat(dirfd, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    int saved_errno;
+
+    if (fd == -1) {
+        return -1;
+    }
+    // not every file system can preallocate, the writes below then allocate as usual
+    if (size >= WRITER_FALLOCATE_MIN && fallocate(fd, 0, 0, size) == -1 &&
+            errno != EOPNOTSUPP && errno != ENOSYS) {
+        goto fail;
+    }
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            goto fail;
+        }
+        data += written;
+        size -= written;
+    }
+    return close(fd);
+
+fail:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+}
+
+static void *bulk_worker(void *arg) {
+    struct bulk_job *job = arg;
+    char name[PATH_MAX];
+    long start;
+    long i;
+
+    while ((start = atomic_fetch_add(&job->next, WRITER_BATCH)) < job->count) {
+        long end = start + WRITER_BATCH < job->count ? start + WRITER_BATCH : job->count;
+
+        for (i = start; i < end; i++) {
+            const char *path = name;
+            const char *data = job->data;
+            size_t size = job->size;
+
+            if (job->manifest) {
+                path = job->manifest[i].path;
+                data = job->manifest[i].data;
+                size = job->manifest[i].size;
+            } else {
+                snprintf(name, sizeof(name), "%s%ld.txt", job->prefix, i + 1);
+            }
+            if (write_file(job->dirfd, path, data, size) == -1) {
+                const char *error = strerror(errno);
+
+                fprintf(stderr, "%s: %s\n", path, error);
+                syslog(LOG_ERR, "Failed to write file %s: %s", path, error);
+                atomic_fetch_add(&job->failures, 1);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Create @param path and its missing parents, like mkdir -p
+ * @return 0 on success, -1 with errno set on failure
+ */
+static int make_dirs(const char *path) {
+    char *copy = strdup(path);
+    char *slash;
+    int rc = 0;
+
+    if (copy == NULL) {
+        return -1;
+    }
+    // a leading slash is the root, which exists
+    for (slash = strchr(copy + (copy[0] == '/'), '/'); rc == 0; slash = strchr(slash + 1, '/')) {
+        if (slash) {
+            *slash = '\0';
+        }
+        if (mkdir(copy, 0755) == -1 && errno != EEXIST) {
+            rc = -1;
+        }
+        if (slash == NULL) {
+            break;
+        }
+        *slash = '/';
+    }
+    free(copy);
+    return rc;
+}
+
+/**
+ * Read the manifest on stdin into @param job, each line owns the path and data of its entry
+ * @return 0 on success, -1 on a malformed line or when out of memory
+ */
+static int read_manifest(struct bulk_job *job) {
+    size_t capacity = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    char *tab;
+
+    while ((length = getline(&line, &line_capacity, stdin)) != -1) {
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+        if (length == 0) {
+            continue;
+        }
+        tab = strchr(line, '\t');
+        if (tab == NULL || tab == line) {
+            fprintf(stderr, "Manifest line %ld is not <path><TAB><string>\n", job->count + 1);
+            free(line);
+            return -1;
+        }
+        if ((size_t)job->count == capacity) {
+            struct manifest_entry *manifest;
+
+            capacity = capacity ? capacity * 2 : 1024;
+            manifest = realloc(job->manifest, capacity * sizeof(*manifest));
+            if (manifest == NULL) {
+                perror("realloc");
+                free(line);
+                return -1;
+            }
+            job->manifest = manifest;
+        }
+        *tab = '\0';
+        job->manifest[job->count].path = line;
+        job->manifest[job->count].data = tab + 1;
+        job->manifest[job->count].size = line + length - (tab + 1);
+        job->count++;
+        // the entry keeps this line, getline() allocates the next one
+        line = NULL;
+        line_capacity = 0;
+    }
+    free(line);
+    return 0;
+}
+
+static int bulk_main(int argc, char *argv[]) {
+    struct bulk_job job = { .dirfd = -1, .count = -1 };
+    bool manifest = false;
+    long nr_threads = 1;
+    pthread_t *threads;
+    const char *dir;
+    long started;
+    long i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:mj:")) != -1) {
+        switch (opt) {
+            case 'n':
+                if (parse_count(optarg, &job.count) == -1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm':
+                manifest = true;
+                break;
+            case 'j':
+                if (parse_count(optarg, &nr_threads) == -1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (manifest == (job.count >= 0) || nr_threads < 1 ||
+            argc - optind != (manifest ? 1 : 3) || argv[optind][0] == '\0') {
+        usage(argv[0]);
+        return 1;
+    }
+    dir = argv[optind];
+    if (!manifest) {
+        job.prefix = argv[optind + 1];
+        job.data = argv[optind + 2];
+        job.size = strlen(job.data);
+    } else {
+        job.count = 0;
+        if (read_manifest(&job) == -1) {
+            return 1;
+        }
+    }
+
+    openlog("coursera-writer", LOG_PID, LOG_USER);
+    syslog(LOG_DEBUG, "Writing %ld files to %s with %ld threads", job.count, dir, nr_threads);
+
+    if (make_dirs(dir) == -1 || (job.dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        perror(dir);
+        syslog(LOG_ERR, "Failed to open directory %s", dir);
+        return 1;
+    }
+
+    threads = calloc(nr_threads, sizeof(*threads));
+    if (threads == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    // the calling thread is one of the workers
+    for (started = 1; started < nr_threads; started++) {
+        if (pthread_create(&threads[started], NULL, bulk_worker, &job) != 0) {
+            break;
+        }
+    }
+    bulk_worker(&job);
+    for (i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    close(job.dirfd);
+
+    for (i = 0; job.manifest && i < job.count; i++) {
+        free(job.manifest[i].path);
+    }
+    free(job.manifest);
+    return atomic_load(&job.failures) ? 1 : 0;
+}
 
 int main(int argc, char *argv[]) {
+    if (argc > 1 && argv[1][0] == '-' && argv[1][1] && strchr("nmj", argv[1][1]) && !argv[1][2]) {
+        return bulk_main(argc, argv);
+    }
     if (argc != 3) {
-        printf("Usage: %s <file> <string>\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
 
@@ -32,4 +330,3 @@ int main(int argc, char *argv[]) {
     fclose(file);
     return 0;
 }
-
@@ -16,7 +16,9 @@
 #include <stdbool.h>
 #include <syslog.h>
 #include <fcntl.h>
+#include <sys/sendfile.h>
 #include "../aesd-char-driver/aesd_ioctl.h"
+#include "../examples/threading/lockprof.h"
 
 #define USE_AESD_CHAR_DEVICE 1
 
@@ -27,10 +29,13 @@
     #define DATA_FILE "/var/tmp/aesdsocketdata"
 #endif
 
+// Largest amount of data forwarded to the client by one sendfile() call
+#define SENDFILE_CHUNK_SIZE 65536
+
 // Declare global variables
 int serverSocket;
 FILE *filePointer;
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+lockprof_mutex_t mutex = LOCKPROF_MUTEX_INITIALIZER;
 pthread_t timestampThread;
 struct aesd_seekto seekto;
 int fd;
@@ -105,7 +110,7 @@ void *handleClient ( void *arg )
     fd = open(DATA_FILE, O_CREAT | O_RDWR | O_APPEND, 0744);
     if (fd == -1) {
         syslog(LOG_ERR, "Failed to open file %s: %s", DATA_FILE, strerror(errno));
-        pthread_mutex_unlock(&mutex);
+        lockprof_mutex_unlock(&mutex);
         close(clientSocket);
         threadInfo->threadComplete = true;
         pthread_exit(NULL);
@@ -157,7 +162,7 @@ void *handleClient ( void *arg )
             }
         }
 
-        pthread_mutex_lock(&mutex);
+        lockprof_mutex_lock(&mutex);
         // Check if the received data is a command
         if(cmd_found)
         {
@@ -178,14 +183,14 @@ void *handleClient ( void *arg )
             {
                 syslog( LOG_ERR, "Failed to write to file %s: %s", DATA_FILE, strerror( errno ) );
                 close( fd );
-                pthread_mutex_unlock( &mutex );
+                lockprof_mutex_unlock( &mutex );
                 close( clientSocket );
                 threadInfo->threadComplete = true;
                 pthread_exit( NULL );
             }
             close( fd );
         }
-        pthread_mutex_unlock( &mutex );
+        lockprof_mutex_unlock( &mutex );
 
         // Check if the received data contains a newline character
         if ( memchr( buffer, '\n', bytesReceived ) != NULL )
@@ -195,7 +200,7 @@ void *handleClient ( void *arg )
         
     }
 
-    pthread_mutex_lock( &mutex );
+    lockprof_mutex_lock( &mutex );
     // Open the file in read mode to send the content back to the client
     if(!cmd_found)
     {
@@ -203,21 +208,30 @@ void *handleClient ( void *arg )
         if (fd == -1) {
             // Handle error
             syslog(LOG_ERR, "Failed to open file %s: %s", DATA_FILE, strerror(errno));
-            pthread_mutex_unlock(&mutex);
+            lockprof_mutex_unlock(&mutex);
             close(clientSocket);
             threadInfo->threadComplete = true;
             pthread_exit(NULL);
         }
     }
 
-    while ( ( bytesReceived = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+    // Let the kernel move the data straight from the file to the socket,
+    // fall back to read/send if the file does not support splicing
+    ssize_t bytesSent;
+    while ( ( bytesSent = sendfile( clientSocket, fd, NULL, SENDFILE_CHUNK_SIZE ) ) > 0 )
+    {
+    }
+    if ( bytesSent == -1 )
     {
-        send( clientSocket, buffer, bytesReceived, 0 );
+        while ( ( bytesReceived = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+        {
+            send( clientSocket, buffer, bytesReceived, 0 );
+        }
     }
     close(fd);
        
     
-    pthread_mutex_unlock( &mutex );
+    lockprof_mutex_unlock( &mutex );
 
     close( clientSocket );
 
@@ -249,12 +263,12 @@ void *appendTimestamp ( void *arg )
 
         strftime( timestamp, sizeof( timestamp ), "timestamp:%a, %d %b %Y %T %z", &timeInfo );
 
-        pthread_mutex_lock( &mutex );
+        lockprof_mutex_lock( &mutex );
         filePointer = fopen( DATA_FILE, "a" );
         if ( filePointer == NULL )
         {
             syslog( LOG_ERR, "Failed to open file %s: %s", DATA_FILE, strerror( errno ) );
-            pthread_mutex_unlock( &mutex );
+            lockprof_mutex_unlock( &mutex );
             pthread_exit( NULL );
         }
 
@@ -264,7 +278,7 @@ void *appendTimestamp ( void *arg )
         {
             syslog( LOG_ERR, "Failed to write timestamp to file" );
             fclose( filePointer );
-            pthread_mutex_unlock( &mutex );
+            lockprof_mutex_unlock( &mutex );
             pthread_exit( NULL );
         }
 
@@ -272,12 +286,12 @@ void *appendTimestamp ( void *arg )
         {
             syslog( LOG_ERR, "Failed to write newline character to file" );
             fclose( filePointer );
-            pthread_mutex_unlock( &mutex );
+            lockprof_mutex_unlock( &mutex );
             pthread_exit( NULL );
         }
 
         fclose( filePointer );
-        pthread_mutex_unlock( &mutex );
+        lockprof_mutex_unlock( &mutex );
 
         // Sleep for 10 seconds
         struct timespec sleepTime = {10, 0};
@@ -288,6 +302,9 @@ void *appendTimestamp ( void *arg )
 int main ( int argc, char *argv[] )
 {
     openlog( "aesdsocket", LOG_PID | LOG_CONS, LOG_USER );
+#ifdef LOCKPROF
+    lockprof_set_name( &mutex, "aesdsocket data file" );
+#endif
 
 #if (USE_AESD_CHAR_DEVICE == 0)
     // Remove the data file if it exists
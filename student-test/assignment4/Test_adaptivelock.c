@@ -0,0 +1,86 @@
+#include "unity.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "../../examples/threading/adaptivelock.h"
+
+#define TEST_ADAPTIVELOCK_THREADS 8
+#define TEST_ADAPTIVELOCK_ITERATIONS 20000
+
+static struct adaptivelock shared_lock = ADAPTIVELOCK_INITIALIZER;
+static long shared_counter;
+static int holders;
+// failed calls and overlapping holders, asserted after the join since Unity assertions must not
+// be made from other threads
+static atomic_int lock_failures;
+static atomic_int exclusion_failures;
+
+static void *increment(void *arg)
+{
+    int i;
+
+    (void)arg;
+    for (i = 0; i < TEST_ADAPTIVELOCK_ITERATIONS; i++)
+    {
+        if (adaptivelock_lock(&shared_lock) != 0)
+        {
+            atomic_fetch_add(&lock_failures, 1);
+            continue;
+        }
+        if (++holders != 1)
+        {
+            atomic_fetch_add(&exclusion_failures, 1);
+        }
+        // a non atomic read modify write, any lost update shows a broken lock
+        shared_counter = shared_counter + 1;
+        holders--;
+        if (adaptivelock_unlock(&shared_lock) != 0)
+        {
+            atomic_fetch_add(&lock_failures, 1);
+        }
+    }
+    return NULL;
+}
+
+void test_adaptivelock_trylock()
+{
+    struct adaptivelock lock;
+
+    adaptivelock_init(&lock);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, adaptivelock_trylock(&lock), "A free lock must be taken");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(EBUSY, adaptivelock_trylock(&lock), "A held lock must not be taken");
+    TEST_ASSERT_EQUAL_INT(0, adaptivelock_unlock(&lock));
+    // more rounds than slots, so the tickets wrap around the slot array
+    for (int i = 0; i < 3 * ADAPTIVELOCK_SLOTS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, adaptivelock_lock(&lock));
+        TEST_ASSERT_EQUAL_INT(EBUSY, adaptivelock_trylock(&lock));
+        TEST_ASSERT_EQUAL_INT(0, adaptivelock_unlock(&lock));
+        TEST_ASSERT_EQUAL_INT(0, adaptivelock_trylock(&lock));
+        TEST_ASSERT_EQUAL_INT(0, adaptivelock_unlock(&lock));
+    }
+}
+
+void test_adaptivelock_mutual_exclusion()
+{
+    pthread_t threads[TEST_ADAPTIVELOCK_THREADS];
+    int i;
+
+    shared_counter = 0;
+    atomic_store(&lock_failures, 0);
+    atomic_store(&exclusion_failures, 0);
+    // waiters sleep on their slot whenever spinning does not pay off, or always on a single CPU
+    for (i = 0; i < TEST_ADAPTIVELOCK_THREADS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL, increment, NULL));
+    }
+    for (i = 0; i < TEST_ADAPTIVELOCK_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, atomic_load(&lock_failures), "Every lock and unlock must succeed");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, atomic_load(&exclusion_failures), "Only one thread may hold the lock");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(TEST_ADAPTIVELOCK_THREADS * TEST_ADAPTIVELOCK_ITERATIONS, shared_counter,
+            "No increment may be lost");
+}
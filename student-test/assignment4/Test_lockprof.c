@@ -0,0 +1,122 @@
+#include "unity.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+// the profiling macros, whatever the build flags
+#ifndef LOCKPROF
+#define LOCKPROF
+#endif
+#include "../../examples/threading/lockprof.h"
+
+#define TEST_LOCKPROF_THREADS 4
+#define TEST_LOCKPROF_ITERATIONS 2000
+
+static struct lockprof_mutex contended_mutex = LOCKPROF_PTHREAD_MUTEX_INITIALIZER;
+static long shared_counter;
+// failed lock or unlock calls, asserted after the join since Unity assertions must not be
+// made from other threads
+static atomic_int contend_failures;
+
+static void *contend(void *arg)
+{
+    int i;
+
+    (void)arg;
+    for (i = 0; i < TEST_LOCKPROF_ITERATIONS; i++)
+    {
+        if (lockprof_lock(&contended_mutex, "contend", 1) != 0)
+        {
+            atomic_fetch_add(&contend_failures, 1);
+            continue;
+        }
+        shared_counter++;
+        // hold long enough for the other threads to queue up behind us now and then
+        if (i % 100 == 0)
+        {
+            usleep(100);
+        }
+        if (lockprof_unlock(&contended_mutex) != 0)
+        {
+            atomic_fetch_add(&contend_failures, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return the dump of every profiled mutex, to be freed by the caller
+ */
+static char *dump_to_string(void)
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+
+    TEST_ASSERT_NOT_NULL(out);
+    lockprof_dump(out);
+    fclose(out);
+    return text;
+}
+
+void test_lockprof_counts_acquisitions()
+{
+    struct lockprof_mutex mutex;
+    char *text;
+    int i;
+
+    lockprof_reset();
+    TEST_ASSERT_EQUAL_INT(0, lockprof_mutex_init(&mutex));
+    lockprof_set_name(&mutex, "test uncontended");
+    for (i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, lockprof_mutex_lock(&mutex));
+        TEST_ASSERT_EQUAL_INT(0, lockprof_mutex_unlock(&mutex));
+    }
+    text = dump_to_string();
+    TEST_ASSERT_TRUE_MESSAGE(strstr(text, "mutex test uncontended") != NULL, "Named mutexes must be reported by name");
+    TEST_ASSERT_TRUE_MESSAGE(strstr(text, "10 acquisitions, 0 contended") != NULL,
+            "Uncontended acquisitions must be counted without a wait");
+    free(text);
+    TEST_ASSERT_EQUAL_INT(0, lockprof_mutex_destroy(&mutex));
+    text = dump_to_string();
+    TEST_ASSERT_TRUE_MESSAGE(strstr(text, "test uncontended") == NULL,
+            "A destroyed mutex must give back its statistics");
+    free(text);
+}
+
+void test_lockprof_records_contention()
+{
+    pthread_t threads[TEST_LOCKPROF_THREADS];
+    char expected[64];
+    char *text;
+    int i;
+
+    lockprof_reset();
+    // claims its slot here, before the first lock
+    lockprof_set_name(&contended_mutex, "test contended");
+    shared_counter = 0;
+    atomic_store(&contend_failures, 0);
+    for (i = 0; i < TEST_LOCKPROF_THREADS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL, contend, NULL));
+    }
+    for (i = 0; i < TEST_LOCKPROF_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, atomic_load(&contend_failures), "Every lock and unlock must succeed");
+    TEST_ASSERT_EQUAL_INT(TEST_LOCKPROF_THREADS * TEST_LOCKPROF_ITERATIONS, shared_counter);
+
+    text = dump_to_string();
+    snprintf(expected, sizeof(expected), "mutex test contended (%p): %d acquisitions",
+            (void *)&contended_mutex, TEST_LOCKPROF_THREADS * TEST_LOCKPROF_ITERATIONS);
+    TEST_ASSERT_TRUE_MESSAGE(strstr(text, expected) != NULL, "Every acquisition must be counted");
+    TEST_ASSERT_TRUE_MESSAGE(strstr(text, "contended wait histogram") != NULL,
+            "Threads sleeping with the mutex held must cause contended acquisitions");
+    TEST_ASSERT_TRUE_MESSAGE(strstr(text, "contend:1 waited") != NULL, "The waiting call site must be listed");
+    free(text);
+    lockprof_reset();
+}
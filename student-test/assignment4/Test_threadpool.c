@@ -0,0 +1,143 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "../../examples/threading/threading.h"
+
+#define TEST_THREADPOOL_TASKS 1000
+#define TEST_THREADPOOL_FIB_N 16
+
+static void *square(void *arg)
+{
+    intptr_t value = (intptr_t)arg;
+
+    return (void *)(value * value);
+}
+
+static struct threadpool *fib_pool;
+// subtasks which could not be submitted, asserted once the workers are done since Unity
+// assertions must not be made from worker threads
+static atomic_int fib_submit_failures;
+
+/**
+ * Recursive fibonacci submitting one branch as a subtask, so workers wait on futures of tasks
+ * queued on their own deque and idle workers have to steal to make progress
+ */
+static void *fib(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    struct threadpool_future *future;
+    intptr_t a;
+
+    if (n < 2)
+    {
+        return (void *)n;
+    }
+    future = threadpool_submit(fib_pool, fib, (void *)(n - 1));
+    a = (intptr_t)fib((void *)(n - 2));
+    if (future == NULL)
+    {
+        atomic_fetch_add(&fib_submit_failures, 1);
+        return (void *)(a + (intptr_t)fib((void *)(n - 1)));
+    }
+    return (void *)(a + (intptr_t)threadpool_future_wait(future));
+}
+
+static atomic_int counter;
+
+static void *count(void *arg)
+{
+    (void)arg;
+    atomic_fetch_add(&counter, 1);
+    return NULL;
+}
+
+void test_threadpool_results()
+{
+    static struct threadpool_future *futures[TEST_THREADPOOL_TASKS];
+    struct threadpool *pool = threadpool_create(4);
+    intptr_t i;
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(pool, "The pool could not be created");
+    for (i = 0; i < TEST_THREADPOOL_TASKS; i++)
+    {
+        futures[i] = threadpool_submit(pool, square, (void *)i);
+        TEST_ASSERT_NOT_NULL(futures[i]);
+    }
+    for (i = 0; i < TEST_THREADPOOL_TASKS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(i * i, (intptr_t)threadpool_future_wait(futures[i]),
+                "Each future must return the result of its own task");
+    }
+
+    // a warm pool recycles the task objects of waited futures
+    futures[0] = threadpool_submit(pool, square, (void *)3);
+    TEST_ASSERT_EQUAL_INT(9, (intptr_t)threadpool_future_wait(futures[0]));
+    futures[1] = threadpool_submit(pool, square, (void *)4);
+    TEST_ASSERT_TRUE_MESSAGE(futures[0] == futures[1], "A released task object must be reused");
+    TEST_ASSERT_EQUAL_INT(16, (intptr_t)threadpool_future_wait(futures[1]));
+    threadpool_destroy(pool);
+}
+
+void test_threadpool_nested_tasks()
+{
+    struct threadpool_future *future;
+
+    intptr_t result;
+
+    fib_pool = threadpool_create(3);
+    TEST_ASSERT_NOT_NULL(fib_pool);
+    atomic_store(&fib_submit_failures, 0);
+    future = threadpool_submit(fib_pool, fib, (void *)TEST_THREADPOOL_FIB_N);
+    TEST_ASSERT_NOT_NULL(future);
+    result = (intptr_t)threadpool_future_wait(future);
+    threadpool_destroy(fib_pool);
+    fib_pool = NULL;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, atomic_load(&fib_submit_failures),
+            "Every subtask must be submitted");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(987, result,
+            "Tasks waiting on their subtasks must not deadlock the pool");
+}
+
+void test_threadpool_destroy_runs_queued_tasks()
+{
+    struct threadpool *pool = threadpool_create(0);
+    int i;
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(pool, "A pool with one worker per CPU could not be created");
+    atomic_store(&counter, 0);
+    for (i = 0; i < TEST_THREADPOOL_TASKS; i++)
+    {
+        // never waited for, freed with the pool
+        TEST_ASSERT_NOT_NULL(threadpool_submit(pool, count, NULL));
+    }
+    threadpool_destroy(pool);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(TEST_THREADPOOL_TASKS, atomic_load(&counter),
+            "Tasks queued before destroy must still run");
+}
+
+void test_threadpool_obtaining_mutex()
+{
+    struct threadpool *pool = threadpool_create(2);
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct thread_data thread_data[4];
+    struct threadpool_future *futures[4];
+    int i;
+
+    TEST_ASSERT_NOT_NULL(pool);
+    for (i = 0; i < 4; i++)
+    {
+        thread_data[i].mutex = &mutex;
+        thread_data[i].wait_to_obtain_ms = 1;
+        thread_data[i].wait_to_release_ms = 1;
+        futures[i] = submit_task_obtaining_mutex(pool, &thread_data[i]);
+        TEST_ASSERT_NOT_NULL(futures[i]);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(threadpool_future_wait(futures[i]) == &thread_data[i]);
+        TEST_ASSERT_TRUE_MESSAGE(thread_data[i].thread_complete_success,
+                "The task must obtain and release the mutex");
+    }
+    threadpool_destroy(pool);
+}
@@ -0,0 +1,73 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../../aesd-char-driver/aesd-byte-ring.h"
+
+/**
+ * Copies the @param len bytes at @param offset of @param ring into @param out
+ * @return the number of spans the range was made of
+ */
+static unsigned int read_ring(struct aesd_byte_ring *ring, size_t offset, size_t len, char *out)
+{
+    struct aesd_byte_ring_span spans[2];
+    unsigned int nr_spans = aesd_byte_ring_spans(ring, offset, len, spans);
+    unsigned int i;
+
+    for (i = 0; i < nr_spans; i++)
+    {
+        memcpy(out, spans[i].ptr, spans[i].len);
+        out += spans[i].len;
+    }
+    return nr_spans;
+}
+
+void test_byte_ring_append_and_consume()
+{
+    struct aesd_byte_ring ring;
+    char data[16];
+    char out[17] = { 0 };
+    size_t offset;
+
+    aesd_byte_ring_init(&ring, data, sizeof(data));
+    TEST_ASSERT_EQUAL_UINT(16, aesd_byte_ring_space(&ring));
+    TEST_ASSERT_TRUE(aesd_byte_ring_append(&ring, "write1\n", 7, &offset));
+    TEST_ASSERT_EQUAL_UINT(0, offset);
+    TEST_ASSERT_TRUE(aesd_byte_ring_append(&ring, "write2\n", 7, &offset));
+    TEST_ASSERT_EQUAL_UINT(7, offset);
+    TEST_ASSERT_FALSE_MESSAGE(aesd_byte_ring_append(&ring, "write3\n", 7, &offset),
+            "A record larger than the free space must be rejected");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(1, read_ring(&ring, 0, 14, out),
+            "Consecutive records which do not wrap must be one span");
+    TEST_ASSERT_EQUAL_STRING("write1\nwrite2\n", out);
+
+    aesd_byte_ring_consume(&ring, 7);
+    TEST_ASSERT_EQUAL_UINT(9, aesd_byte_ring_space(&ring));
+    TEST_ASSERT_EQUAL_UINT(7, aesd_byte_ring_offset(&ring, 0));
+}
+
+void test_byte_ring_wrap_around()
+{
+    struct aesd_byte_ring ring;
+    char data[16];
+    char out[17] = { 0 };
+    size_t offset;
+
+    aesd_byte_ring_init(&ring, data, sizeof(data));
+    TEST_ASSERT_TRUE(aesd_byte_ring_append(&ring, "0123456789\n", 11, &offset));
+    aesd_byte_ring_consume(&ring, 11);
+    // consuming everything restarts the ring at offset 0
+    TEST_ASSERT_EQUAL_UINT(0, aesd_byte_ring_offset(&ring, 0));
+
+    TEST_ASSERT_TRUE(aesd_byte_ring_append(&ring, "abcdefghij\n", 11, &offset));
+    aesd_byte_ring_consume(&ring, 6);
+    TEST_ASSERT_TRUE(aesd_byte_ring_append(&ring, "klmnopqr\n", 9, &offset));
+    TEST_ASSERT_EQUAL_UINT(11, offset);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(2, read_ring(&ring, offset, 9, out),
+            "A record crossing the end of the ring must be two spans");
+    TEST_ASSERT_EQUAL_STRING("klmnopqr\n", out);
+
+    memset(out, 0, sizeof(out));
+    TEST_ASSERT_EQUAL_UINT(2, read_ring(&ring, aesd_byte_ring_offset(&ring, 0), 14, out));
+    TEST_ASSERT_EQUAL_STRING("ghij\nklmnopqr\n", out);
+    TEST_ASSERT_EQUAL_UINT(0, read_ring(&ring, 0, 0, out));
+}
@@ -0,0 +1,92 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../../aesd-char-driver/aesd-circular-buffer.h"
+
+/**
+ * Concatenates the @param count elements of @param iov into @param out as a string
+ */
+static void join_iovec(const aesd_iovec_t *iov, size_t count, char *out)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(out, iov[i].iov_base, iov[i].iov_len);
+        out += iov[i].iov_len;
+    }
+    *out = '\0';
+}
+
+static void add_string(struct aesd_circular_buffer *buffer, const char *str)
+{
+    struct aesd_buffer_entry entry;
+
+    entry.buffptr = str;
+    entry.size = strlen(str);
+    aesd_circular_buffer_add_entry(buffer, &entry);
+}
+
+void test_export_iovec_partial_first_entry()
+{
+    struct aesd_circular_buffer buffer;
+    aesd_iovec_t iov[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    char out[256];
+    size_t bytes;
+    size_t count;
+
+    aesd_circular_buffer_init(&buffer);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, aesd_circular_buffer_export_iovec(&buffer, 0, 100, iov, 10, &bytes),
+            "An empty buffer must export nothing");
+    add_string(&buffer, "write1\n");
+    add_string(&buffer, "write2\n");
+    add_string(&buffer, "write3\n");
+
+    count = aesd_circular_buffer_export_iovec(&buffer, 3, 100, iov, 10, &bytes);
+    TEST_ASSERT_EQUAL_UINT(3, count);
+    TEST_ASSERT_EQUAL_UINT(18, bytes);
+    join_iovec(iov, count, out);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("te1\nwrite2\nwrite3\n", out,
+            "The first element must start at the requested offset within its entry");
+
+    count = aesd_circular_buffer_export_iovec(&buffer, 7, 9, iov, 10, &bytes);
+    TEST_ASSERT_EQUAL_UINT(2, count);
+    join_iovec(iov, count, out);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("write2\nwr", out, "The last element must be shortened to max_bytes");
+
+    count = aesd_circular_buffer_export_iovec(&buffer, 0, 100, iov, 2, &bytes);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(2, count, "No more than iov_max elements may be filled");
+    TEST_ASSERT_EQUAL_UINT(14, bytes);
+    TEST_ASSERT_EQUAL_UINT(0, aesd_circular_buffer_export_iovec(&buffer, 21, 100, iov, 10, &bytes));
+}
+
+void test_export_iovec_wrap_around()
+{
+    struct aesd_circular_buffer buffer;
+    aesd_iovec_t iov[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    char out[256];
+    char records[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED + 3][4];
+    char expected[256] = "";
+    size_t bytes;
+    size_t count;
+    int i;
+
+    aesd_circular_buffer_init(&buffer);
+    for (i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED + 3; i++)
+    {
+        records[i][0] = 'a' + i;
+        records[i][1] = '\n';
+        records[i][2] = '\0';
+        add_string(&buffer, records[i]);
+        if (i >= 4)
+        {
+            strcat(expected, records[i]);
+        }
+    }
+    // the oldest three were overwritten, skip one more record to start part way through the ring
+    count = aesd_circular_buffer_export_iovec(&buffer, 2, 1000, iov, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &bytes);
+    TEST_ASSERT_EQUAL_UINT(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - 1, count);
+    join_iovec(iov, count, out);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, out, "Entries must be exported in logical order across the wrap");
+    TEST_ASSERT_EQUAL_UINT(strlen(expected), bytes);
+}
@@ -0,0 +1,182 @@
+#include "unity.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "../../aesd-char-driver/aesd-lockfree-buffer.h"
+
+#define MPSC_PRODUCERS 4
+#define MPSC_ENTRIES_PER_PRODUCER 20000
+
+/**
+ * Entries used by the tests carry a producer number in buffptr and a sequence number in size
+ */
+static struct aesd_buffer_entry make_entry(uintptr_t producer, size_t sequence)
+{
+    struct aesd_buffer_entry entry;
+    entry.buffptr = (const char *)producer;
+    entry.size = sequence;
+    return entry;
+}
+
+void test_lockfree_init_rejects_bad_capacity()
+{
+    struct aesd_lockfree_buffer buffer;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, aesd_lockfree_buffer_init(&buffer, 12, AESD_LOCKFREE_SPSC),
+            "Capacity must be a power of two");
+    TEST_ASSERT_EQUAL_INT(EINVAL, errno);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, aesd_lockfree_buffer_init(&buffer, 1, AESD_LOCKFREE_MPSC),
+            "Capacity must be at least 2");
+}
+
+static void verify_fifo_until_full(enum aesd_lockfree_mode mode)
+{
+    struct aesd_lockfree_buffer buffer;
+    struct aesd_buffer_entry entry;
+    size_t i;
+
+    TEST_ASSERT_EQUAL_INT(0, aesd_lockfree_buffer_init(&buffer, 8, mode));
+    TEST_ASSERT_FALSE_MESSAGE(aesd_lockfree_buffer_dequeue(&buffer, &entry), "New buffer must be empty");
+    for (i = 0; i < 8; i++)
+    {
+        entry = make_entry(0, i);
+        TEST_ASSERT_TRUE(aesd_lockfree_buffer_enqueue(&buffer, &entry));
+    }
+    entry = make_entry(0, 8);
+    TEST_ASSERT_FALSE_MESSAGE(aesd_lockfree_buffer_enqueue(&buffer, &entry),
+            "A full buffer must reject entries instead of overwriting");
+    for (i = 0; i < 8; i++)
+    {
+        TEST_ASSERT_TRUE(aesd_lockfree_buffer_dequeue(&buffer, &entry));
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(i, entry.size, "Entries must come out in the order they went in");
+    }
+    TEST_ASSERT_FALSE(aesd_lockfree_buffer_dequeue(&buffer, &entry));
+    aesd_lockfree_buffer_destroy(&buffer);
+}
+
+void test_lockfree_spsc_fifo()
+{
+    verify_fifo_until_full(AESD_LOCKFREE_SPSC);
+}
+
+void test_lockfree_mpsc_fifo()
+{
+    verify_fifo_until_full(AESD_LOCKFREE_MPSC);
+}
+
+static void verify_batch(enum aesd_lockfree_mode mode)
+{
+    struct aesd_lockfree_buffer buffer;
+    struct aesd_buffer_entry in[16];
+    struct aesd_buffer_entry out[16];
+    size_t i;
+    size_t lap;
+
+    TEST_ASSERT_EQUAL_INT(0, aesd_lockfree_buffer_init(&buffer, 8, mode));
+    for (i = 0; i < 16; i++)
+    {
+        in[i] = make_entry(0, i);
+    }
+    // run several laps so the positions wrap around the slots
+    for (lap = 0; lap < 3; lap++)
+    {
+        TEST_ASSERT_EQUAL_UINT(5, aesd_lockfree_buffer_enqueue_batch(&buffer, in, 5));
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(3, aesd_lockfree_buffer_enqueue_batch(&buffer, &in[5], 11),
+                "A batch larger than the free space must be truncated");
+        TEST_ASSERT_EQUAL_UINT(0, aesd_lockfree_buffer_enqueue_batch(&buffer, in, 1));
+        TEST_ASSERT_EQUAL_UINT(6, aesd_lockfree_buffer_dequeue_batch(&buffer, out, 6));
+        TEST_ASSERT_EQUAL_UINT(2, aesd_lockfree_buffer_dequeue_batch(&buffer, &out[6], 16));
+        for (i = 0; i < 8; i++)
+        {
+            TEST_ASSERT_EQUAL_UINT(i, out[i].size);
+        }
+    }
+    aesd_lockfree_buffer_destroy(&buffer);
+}
+
+void test_lockfree_spsc_batch()
+{
+    verify_batch(AESD_LOCKFREE_SPSC);
+}
+
+void test_lockfree_mpsc_batch()
+{
+    verify_batch(AESD_LOCKFREE_MPSC);
+}
+
+static struct aesd_lockfree_buffer mpsc_buffer;
+
+static void *mpsc_producer(void *arg)
+{
+    uintptr_t producer = (uintptr_t)arg;
+    struct aesd_buffer_entry batch[3];
+    size_t sequence = 0;
+    size_t added;
+
+    while (sequence < MPSC_ENTRIES_PER_PRODUCER)
+    {
+        // alternate single and batch enqueues
+        if (sequence % 2)
+        {
+            batch[0] = make_entry(producer, sequence);
+            added = aesd_lockfree_buffer_enqueue(&mpsc_buffer, &batch[0]) ? 1 : 0;
+        }
+        else
+        {
+            size_t n = 0;
+            while (n < 3 && sequence + n < MPSC_ENTRIES_PER_PRODUCER)
+            {
+                batch[n] = make_entry(producer, sequence + n);
+                n++;
+            }
+            added = aesd_lockfree_buffer_enqueue_batch(&mpsc_buffer, batch, n);
+        }
+        if (added == 0)
+        {
+            sched_yield();
+        }
+        sequence += added;
+    }
+    return NULL;
+}
+
+void test_lockfree_mpsc_concurrent_producers()
+{
+    pthread_t threads[MPSC_PRODUCERS];
+    size_t next_sequence[MPSC_PRODUCERS] = { 0 };
+    struct aesd_buffer_entry out[32];
+    size_t received = 0;
+    size_t n;
+    size_t i;
+    uintptr_t p;
+
+    TEST_ASSERT_EQUAL_INT(0, aesd_lockfree_buffer_init(&mpsc_buffer, 64, AESD_LOCKFREE_MPSC));
+    for (p = 0; p < MPSC_PRODUCERS; p++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[p], NULL, mpsc_producer, (void *)p));
+    }
+    while (received < MPSC_PRODUCERS * MPSC_ENTRIES_PER_PRODUCER)
+    {
+        n = aesd_lockfree_buffer_dequeue_batch(&mpsc_buffer, out, 32);
+        if (n == 0)
+        {
+            sched_yield();
+        }
+        for (i = 0; i < n; i++)
+        {
+            p = (uintptr_t)out[i].buffptr;
+            TEST_ASSERT_TRUE(p < MPSC_PRODUCERS);
+            TEST_ASSERT_EQUAL_UINT_MESSAGE(next_sequence[p], out[i].size,
+                    "Entries of each producer must arrive once and in order");
+            next_sequence[p]++;
+        }
+        received += n;
+    }
+    for (p = 0; p < MPSC_PRODUCERS; p++)
+    {
+        pthread_join(threads[p], NULL);
+    }
+    TEST_ASSERT_FALSE(aesd_lockfree_buffer_dequeue(&mpsc_buffer, &out[0]));
+    aesd_lockfree_buffer_destroy(&mpsc_buffer);
+}